@@ -35,6 +35,7 @@ extern "C" {
 #include <stdbool.h>
 #ifdef _WIN32
 #include <io.h>
+#include <malloc.h>
 #include <dirent.h>
 #define F_OK 0
 #define access _access
@@ -79,6 +80,14 @@ typedef union color_t {
 */
 typedef color_t* bitmap_t;
 
+// Bytes in front of the pixels, a whole cache line so the pixels start on one
+#define BITMAP_HEADER_SIZE 64
+// Alignment of the pixels of images allocated by this library, their size is
+// also rounded up to it so vector loads of the last pixels stay in bounds
+#define BITMAP_ALIGNMENT 64
+// Images at least this big are aligned to and advised as huge pages on Linux
+#define BITMAP_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 /*!
  * @function bitmap_empty
  * @brief Creates a new empty image filled with a specified color.
@@ -93,11 +102,83 @@ bitmap_t bitmap_empty(unsigned int w, unsigned int h, color_t color);
 /*!
  * @function bitmap_destroy
  * @brief Frees the memory associated with an image.
- * @discussion Releases all memory allocated for the image. The image pointer becomes invalid after this call and should not be used.
+ * @discussion Releases all memory allocated for the image. The image pointer becomes invalid after this call and should not be used. Images placed with bitmap_wrap() or a custom allocator are left alone.
  * @param img The image to destroy.
 */
 void bitmap_destroy(bitmap_t img);
 
+/*!
+ * @function bitmap_wrap
+ * @brief Creates an image inside caller-owned memory.
+ * @discussion Writes the image header to the start of the memory and returns the pixels that follow it. The memory must hold BITMAP_HEADER_SIZE bytes plus w * h pixels and stays owned by the caller, bitmap_destroy() leaves it alone.
+ * @param memory The memory to place the image in.
+ * @param w The width of the image in pixels.
+ * @param h The height of the image in pixels.
+ * @return A pointer to the image pixels, or NULL if memory is NULL.
+*/
+bitmap_t bitmap_wrap(void *memory, unsigned int w, unsigned int h);
+
+/*!
+ * @function bitmap_alloc
+ * @brief Allocates memory the way images are allocated.
+ * @discussion The memory is BITMAP_ALIGNMENT aligned and its size rounded up to it. Free it with bitmap_free().
+ * @param size The number of bytes needed.
+ * @return The memory, or NULL on allocation failure.
+*/
+void* bitmap_alloc(size_t size);
+
+/*!
+ * @function bitmap_free
+ * @brief Frees memory returned by bitmap_alloc().
+ * @param memory The memory to free, may be NULL.
+*/
+void bitmap_free(void *memory);
+
+/*!
+ * @function bitmap_set_allocator
+ * @brief Replaces where new images get their memory from.
+ * @discussion Every image made after this call, by any function, is placed with bitmap_wrap() in memory from alloc instead of bitmap_alloc(). alloc is passed the bytes needed and userdata, and must return BITMAP_ALIGNMENT aligned memory or NULL. Those images belong to the allocator, bitmap_destroy() leaves them alone. Only affects the calling thread, pass NULL to go back to bitmap_alloc().
+ * @param alloc The allocator, or NULL.
+ * @param userdata Passed to every call of alloc.
+*/
+void bitmap_set_allocator(void*(*alloc)(size_t, void*), void *userdata);
+
+/*!
+ * @function bitmap_userdata
+ * @brief Gets the pointer stored in an image's header.
+ * @discussion Images have room for one pointer of user data, NULL until bitmap_set_userdata() is called. Nothing in this library reads it or frees it.
+ * @param img The image to query.
+ * @return The stored pointer, or NULL.
+*/
+void* bitmap_userdata(const bitmap_t img);
+
+/*!
+ * @function bitmap_set_userdata
+ * @brief Stores a pointer in an image's header.
+ * @discussion Copies made with bitmap_dupe() and friends don't inherit it, the caller owns whatever it points to.
+ * @param img The image to modify.
+ * @param userdata The pointer to store.
+*/
+void bitmap_set_userdata(bitmap_t img, void *userdata);
+
+/*!
+ * @function bitmap_padding
+ * @brief Gets how many columns at the end of each row aren't part of the picture.
+ * @discussion 0 until bitmap_set_padding() is called. Nothing in this library reads it, the width still counts those columns.
+ * @param img The image to query.
+ * @return The number of padding columns.
+*/
+int bitmap_padding(const bitmap_t img);
+
+/*!
+ * @function bitmap_set_padding
+ * @brief Marks columns at the end of each row as padding rather than picture.
+ * @discussion Copies made with bitmap_dupe() and friends don't inherit it.
+ * @param img The image to modify.
+ * @param columns The number of padding columns, at most the width.
+*/
+void bitmap_set_padding(bitmap_t img, unsigned int columns);
+
 /*!
  * @function bitmap_width
  * @brief Gets the width of an image in pixels.
@@ -446,6 +527,10 @@ bitmap_t bitmap_load(const void* data, int width, int height, bitmap_format_t fo
 
 static _CONSTEXPR color_t _black = { 0.0f, 0.0f, 0.0f, 1.0f };
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #ifndef PAUL_COLOR_HEADER
 static float color_distance(color_t a, color_t b) {
     int dr = a.r - b.r;
@@ -455,14 +540,72 @@ static float color_distance(color_t a, color_t b) {
 }
 #endif
 
-static color_t* bitmap_make(unsigned int w, unsigned int h) {
+typedef struct {
+    void *userdata;
+    uint32_t w, h;
+    uint32_t padding;
+    bool owned;
+} _bitmap_header;
+
+// Per thread, so one thread swapping allocators can't capture another's images
+static _Thread_local void*(*_bitmap_allocator)(size_t, void*) = NULL;
+static _Thread_local void *_bitmap_allocator_userdata = NULL;
+
+bitmap_t bitmap_wrap(void *memory, unsigned int w, unsigned int h) {
     static_assert(sizeof(color_t) == sizeof(uint32_t), "color_t must be 4 bytes");
-    uint32_t *buffer = (uint32_t*)malloc((w * h + 2) * sizeof(uint32_t));
-    if (!buffer)
+    static_assert(sizeof(_bitmap_header) <= BITMAP_HEADER_SIZE, "bitmap header too large");
+    if (!memory)
         return NULL;
-    buffer[0] = w;
-    buffer[1] = h;
-    return (color_t*)(buffer + 2);
+    _bitmap_header *header = (_bitmap_header*)memory;
+    header->userdata = NULL;
+    header->w = w;
+    header->h = h;
+    header->padding = 0;
+    header->owned = false;
+    return (color_t*)((uint8_t*)memory + BITMAP_HEADER_SIZE);
+}
+
+void* bitmap_alloc(size_t size) {
+    size = (size + BITMAP_ALIGNMENT - 1) & ~(size_t)(BITMAP_ALIGNMENT - 1);
+#ifdef _WIN32
+    return _aligned_malloc(size, BITMAP_ALIGNMENT);
+#else
+    void *memory = NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // Big framebuffers take a TLB miss every few rows on 4K pages
+    if (size >= BITMAP_HUGE_PAGE_SIZE) {
+        size = (size + BITMAP_HUGE_PAGE_SIZE - 1) & ~(size_t)(BITMAP_HUGE_PAGE_SIZE - 1);
+        if (posix_memalign(&memory, BITMAP_HUGE_PAGE_SIZE, size))
+            return NULL;
+        madvise(memory, size, MADV_HUGEPAGE);
+        return memory;
+    }
+#endif
+    return posix_memalign(&memory, BITMAP_ALIGNMENT, size) ? NULL : memory;
+#endif
+}
+
+void bitmap_free(void *memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void bitmap_set_allocator(void*(*alloc)(size_t, void*), void *userdata) {
+    _bitmap_allocator = alloc;
+    _bitmap_allocator_userdata = userdata;
+}
+
+static color_t* bitmap_make(unsigned int w, unsigned int h) {
+    size_t size = BITMAP_HEADER_SIZE + (size_t)w * h * sizeof(uint32_t);
+    if (_bitmap_allocator)
+        return bitmap_wrap(_bitmap_allocator(size, _bitmap_allocator_userdata), w, h);
+    color_t *result = bitmap_wrap(bitmap_alloc(size), w, h);
+    if (result)
+        ((_bitmap_header*)((uint8_t*)result - BITMAP_HEADER_SIZE))->owned = true;
+    return result;
 }
 
 bitmap_t bitmap_empty(unsigned int w, unsigned int h, color_t color) {
@@ -471,36 +614,58 @@ bitmap_t bitmap_empty(unsigned int w, unsigned int h, color_t color) {
     bitmap_t result = bitmap_make(w, h);
     if (!result)
         return NULL;
-    bitmap_fill(result, _black);
+    bitmap_fill(result, color);
     return result;
 }
 
-static uint32_t* _raw(bitmap_t img) {
-    return img ? (uint32_t*)(img) - 2 : NULL;
+static _bitmap_header* _raw(bitmap_t img) {
+    return img ? (_bitmap_header*)((uint8_t*)img - BITMAP_HEADER_SIZE) : NULL;
 }
 
 void bitmap_destroy(bitmap_t img) {
-    uint32_t *raw = _raw(img);
-    if (raw)
-        free(raw);
+    _bitmap_header *raw = _raw(img);
+    if (raw && raw->owned)
+        bitmap_free(raw);
 }
 
 int bitmap_width(const bitmap_t img) {
-    uint32_t *raw = _raw(img);
-    return raw ? raw[0] : 0;
+    _bitmap_header *raw = _raw(img);
+    return raw ? raw->w : 0;
 }
 
 int bitmap_height(const bitmap_t img) {
-    uint32_t *raw = _raw(img);
-    return raw ? raw[1] : 0;
+    _bitmap_header *raw = _raw(img);
+    return raw ? raw->h : 0;
+}
+
+void* bitmap_userdata(const bitmap_t img) {
+    _bitmap_header *raw = _raw(img);
+    return raw ? raw->userdata : NULL;
+}
+
+void bitmap_set_userdata(bitmap_t img, void *userdata) {
+    _bitmap_header *raw = _raw(img);
+    if (raw)
+        raw->userdata = userdata;
+}
+
+int bitmap_padding(const bitmap_t img) {
+    _bitmap_header *raw = _raw(img);
+    return raw ? raw->padding : 0;
+}
+
+void bitmap_set_padding(bitmap_t img, unsigned int columns) {
+    _bitmap_header *raw = _raw(img);
+    if (raw)
+        raw->padding = columns < raw->w ? columns : raw->w;
 }
 
 bool bitmap_size(const bitmap_t img, int *w, int *h) {
     if (!img || (!w && !h))
         return false;
-    uint32_t *raw = _raw(img);
-    int _w = raw ? raw[0] : 0;
-    int _h = raw ? raw[1] : 0;
+    _bitmap_header *raw = _raw(img);
+    int _w = raw ? raw->w : 0;
+    int _h = raw ? raw->h : 0;
     if (w)
         *w = _w;
     if (h)
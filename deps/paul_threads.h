@@ -62,10 +62,13 @@ extern "C" {
 #include <atomic>
 typedef bool atomic_bool;
 typedef size_t atomic_size_t;
+typedef long long atomic_llong;
 #define atomic_load(p) (*(p))
 #define atomic_fetch_add(p, v) ((*(p)) += (v))
 #define atomic_fetch_sub(p, v) ((*(p)) -= (v))
 #define atomic_store(p, v) ((*(p)) = (v))
+#define atomic_compare_exchange_strong(p, e, d) \
+    (*(p) == *(e) ? ((*(p) = (d)), true) : ((*(e) = *(p)), false))
 #else
 #if __STDC_VERSION__ >= 201112L && __has_include(<stdatomic.h>)
 #include <stdatomic.h>
@@ -92,6 +95,7 @@ typedef size_t atomic_size_t;
 #endif
 
 #include <time.h>
+#include <stdint.h>
 
 #if __STDC_VERSION__ >= 201112L && __has_include(<threads.h>)
 #include <threads.h>
@@ -378,65 +382,69 @@ typedef struct job {
     void (*cleanup)(void *arg); // Optional cleanup function
 } job_t;
 
-/*!
- @typedef job_node_t
- @field job The job contained in this node
- @field next Pointer to the next node
- @discussion Node structure for the job queue
-*/
-typedef struct job_node {
-    job_t job;
-    struct job_node *next;
-} job_node_t;
+#ifndef THRD_POOL_DEQUE_SIZE
+#define THRD_POOL_DEQUE_SIZE 4096
+#endif
+
+#ifndef THRD_POOL_SPIN_COUNT
+#define THRD_POOL_SPIN_COUNT 64
+#endif
 
 /*!
- @typedef job_queue_t
- @field head Pointer to the head of the job queue
- @field tail Pointer to the tail of the job queue
- @field mutex Mutex for thread safety
- @field not_empty Condition variable for waiting on empty queue
- @field size Current number of jobs in the queue
- @field max_size Maximum size of the queue
- @field shutdown Flag indicating if the queue is shutting down
- @discussion Job queue structure for thread pool
+ @typedef job_deque_t
+ @field top Index thieves steal from
+ @field bottom Index the owner pushes to and pops from
+ @field capacity Number of slots in the ring buffer (power of two)
+ @field jobs Ring buffer of jobs
+ @discussion Fixed-size Chase-Lev work-stealing deque. Only the owning thread may push or pop, any thread may steal.
 */
-typedef struct job_queue {
-    job_node_t *head;
-    job_node_t *tail;
-    mtx_t mutex;
-    cnd_t not_empty;
-    size_t size;
-    size_t max_size;
-    bool shutdown;
-} job_queue_t;
+typedef struct job_deque {
+    atomic_llong top;
+    atomic_llong bottom;
+    size_t capacity;
+    job_t *jobs;
+} job_deque_t;
 
 /*!
  @typedef thrd_pool_t
  @field threads Array of worker threads
  @field num_threads Number of worker threads
- @field job_queue The job queue
+ @field deques Work-stealing deques, one per worker, one for the thread that created the pool and one shared by every other thread
+ @field owner The thread that created the pool
  @field shutdown Atomic flag indicating if the pool is shutting down
- @field active_threads Atomic count of active threads
- @field pool_mutex Mutex for pool operations
- @field all_threads_idle Condition variable for waiting on all threads idle
+ @field started Atomic count of workers that have claimed a deque
+ @field active_threads Atomic count of threads running a job
+ @field pending Atomic count of jobs submitted but not yet finished
+ @field queued Atomic count of jobs waiting in the deques
+ @field sleepers Atomic count of workers blocked waiting for work
+ @field pool_mutex Mutex guarding sleeping workers
+ @field work_available Condition variable signalled when jobs are submitted to sleeping workers
+ @field inject_mutex Mutex serialising pushes to the shared deque
  @discussion Thread pool structure
 */
 typedef struct {
     thrd_t *threads;
     size_t num_threads;
-    job_queue_t job_queue;
+    job_deque_t *deques;
+    thrd_t owner;
     atomic_bool shutdown;
+    atomic_size_t started;
     atomic_size_t active_threads;
+    atomic_size_t pending;
+    atomic_size_t queued;
+    atomic_size_t sleepers;
     mtx_t pool_mutex;
-    cnd_t all_threads_idle;
+    cnd_t work_available;
+    mtx_t inject_mutex;
 } thrd_pool_t;
 
 /*!
  @function thrd_pool_create
  @param num_threads Number of worker threads
- @param max_queue_size Maximum size of the job queue
+ @param max_queue_size Capacity of each worker's deque (0 = THRD_POOL_DEQUE_SIZE)
  @return Returns a pointer to the created thread pool, or NULL on failure
  @brief Create a thread pool
+ @discussion Submissions from the creating thread and from inside jobs are lock-free, submissions from any other thread take a mutex.
 */
 thrd_pool_t* thrd_pool_create(size_t num_threads, size_t max_queue_size);
 /*!
@@ -447,14 +455,24 @@ thrd_pool_t* thrd_pool_create(size_t num_threads, size_t max_queue_size);
  @param cleanup Optional cleanup function
  @return Returns thrd_success on success, thrd_error on failure
  @brief Submit a job to the thread pool
+ @discussion If the submitting thread's deque is full the job is run immediately on the calling thread.
 */
 int thrd_pool_submit(thrd_pool_t *pool, void (*function)(void*), void *arg, void (*cleanup)(void*));
 /*!
  @function thrd_pool_wait
  @param pool Pointer to the thread pool
  @brief Wait for all jobs in the thread pool to complete
+ @discussion The calling thread helps run queued jobs while it waits. Must not be called from inside a job.
 */
 void thrd_pool_wait(thrd_pool_t *pool);
+/*!
+ @function thrd_pool_help
+ @param pool Pointer to the thread pool
+ @return Returns true if a job was run, false if there was nothing queued
+ @brief Run one queued job on the calling thread
+ @discussion Lets a thread waiting on its own work keep the pool busy without waiting on every other job.
+*/
+bool thrd_pool_help(thrd_pool_t *pool);
 /*!
  @function thrd_pool_destroy
  @param pool Pointer to the thread pool
@@ -478,8 +496,8 @@ size_t thrd_pool_get_active_count(thrd_pool_t *pool);
 /*!
  @function thrd_pool_get_queue_size
  @param pool Pointer to the thread pool
- @return Returns the size of the job queue
- @brief Get the size of the job queue in the thread pool
+ @return Returns the number of queued jobs
+ @brief Get the number of jobs waiting in the thread pool
 */
 size_t thrd_pool_get_queue_size(thrd_pool_t *pool);
 
@@ -1196,141 +1214,151 @@ void thrd_queue_shutdown(thrd_queue_t *queue) {
     cnd_broadcast(&queue->not_empty);
 }
 
-static int job_queue_init(job_queue_t *queue, size_t max_size) {
-    if (!queue)
-        return thrd_error;
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
-    queue->max_size = max_size;
-    queue->shutdown = false;
-    if (mtx_init(&queue->mutex, mtx_plain) != thrd_success)
-        return thrd_error;
-    if (cnd_init(&queue->not_empty) != thrd_success) {
-        mtx_destroy(&queue->mutex);
-        return thrd_error;
-    }
-    return thrd_success;
-}
-
-static void job_queue_destroy(job_queue_t *queue) {
-    if (!queue)
-        return;
-    mtx_lock(&queue->mutex);
-    queue->shutdown = true;
-    while (queue->head) {
-        job_node_t *temp = queue->head;
-        queue->head = queue->head->next;
-        if (temp->job.cleanup && temp->job.arg)
-            temp->job.cleanup(temp->job.arg);
-        free(temp);
-    }
-    mtx_unlock(&queue->mutex);
-    cnd_broadcast(&queue->not_empty);
-    mtx_destroy(&queue->mutex);
-    cnd_destroy(&queue->not_empty);
-}
-
-static int job_queue_enqueue(job_queue_t *queue, job_t job) {
-    if (!queue)
-        return thrd_error;
-
-    mtx_lock(&queue->mutex);
-
-    if (queue->shutdown) {
-        mtx_unlock(&queue->mutex);
-        return thrd_error;
-    }
-
-    if (queue->max_size > 0 && queue->size >= queue->max_size) {
-        mtx_unlock(&queue->mutex);
-        return thrd_busy; // Queue is full
-    }
+#if defined(__cplusplus)
+#define THRD_POOL_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define THRD_POOL_THREAD_LOCAL __declspec(thread)
+#else
+#define THRD_POOL_THREAD_LOCAL _Thread_local
+#endif
 
-    job_node_t *new_node = (job_node_t*)malloc(sizeof(job_node_t));
-    if (!new_node) {
-        mtx_unlock(&queue->mutex);
+// Lets a worker find its own deque when a running job submits more work
+static THRD_POOL_THREAD_LOCAL struct {
+    thrd_pool_t *pool;
+    size_t index;
+} thrd_pool_self = {NULL, 0};
+
+static int job_deque_init(job_deque_t *deque, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    if (!(deque->jobs = (job_t*)malloc(sizeof(job_t) * size)))
         return thrd_nomem;
-    }
-
-    new_node->job = job;
-    new_node->next = NULL;
-
-    if (queue->tail)
-        queue->tail->next = new_node;
-    else
-        queue->head = new_node;
-
-    queue->tail = new_node;
-    queue->size++;
-    cnd_signal(&queue->not_empty);
-    mtx_unlock(&queue->mutex);
+    deque->capacity = size;
+    atomic_store(&deque->top, 0);
+    atomic_store(&deque->bottom, 0);
     return thrd_success;
 }
 
-static int job_queue_dequeue(job_queue_t *queue, job_t *job) {
-    if (!queue || !job)
-        return thrd_error;
-
-    mtx_lock(&queue->mutex);
-
-    while (queue->head == NULL && !queue->shutdown)
-        cnd_wait(&queue->not_empty, &queue->mutex);
-
-    if (queue->shutdown && queue->head == NULL) {
-        mtx_unlock(&queue->mutex);
-        return thrd_error;
+static void job_deque_destroy(job_deque_t *deque) {
+    long long top = atomic_load(&deque->top);
+    long long bottom = atomic_load(&deque->bottom);
+    for (long long i = top; i < bottom; i++) {
+        job_t *job = &deque->jobs[i & (deque->capacity - 1)];
+        if (job->cleanup && job->arg)
+            job->cleanup(job->arg);
     }
-
-    job_node_t *node = queue->head;
-    *job = node->job;
-    queue->head = queue->head->next;
-
-    if (queue->head == NULL)
-        queue->tail = NULL;
-
-    queue->size--;
-    free(node);
-    mtx_unlock(&queue->mutex);
-    return thrd_success;
+    free(deque->jobs);
+}
+
+// Owner only
+static bool job_deque_push(job_deque_t *deque, job_t job) {
+    long long bottom = atomic_load(&deque->bottom);
+    long long top = atomic_load(&deque->top);
+    if (bottom - top >= (long long)deque->capacity)
+        return false;
+    deque->jobs[bottom & (deque->capacity - 1)] = job;
+    atomic_store(&deque->bottom, bottom + 1);
+    return true;
+}
+
+// Owner only
+static bool job_deque_pop(job_deque_t *deque, job_t *job) {
+    long long bottom = atomic_load(&deque->bottom) - 1;
+    atomic_store(&deque->bottom, bottom);
+    long long top = atomic_load(&deque->top);
+    if (top > bottom) {
+        atomic_store(&deque->bottom, bottom + 1);
+        return false;
+    }
+    *job = deque->jobs[bottom & (deque->capacity - 1)];
+    if (top != bottom)
+        return true;
+    // Last job left, race any thieves for it
+    bool won = atomic_compare_exchange_strong(&deque->top, &top, top + 1);
+    atomic_store(&deque->bottom, bottom + 1);
+    return won;
+}
+
+// Any thread
+static bool job_deque_steal(job_deque_t *deque, job_t *job) {
+    long long top = atomic_load(&deque->top);
+    long long bottom = atomic_load(&deque->bottom);
+    if (top >= bottom)
+        return false;
+    job_t stolen = deque->jobs[top & (deque->capacity - 1)];
+    if (!atomic_compare_exchange_strong(&deque->top, &top, top + 1))
+        return false;
+    *job = stolen;
+    return true;
+}
+
+// Index of the calling thread's own deque, or SIZE_MAX if it has none
+static size_t thrd_pool_home(thrd_pool_t *pool) {
+    if (thrd_pool_self.pool == pool)
+        return thrd_pool_self.index;
+    if (thrd_equal(thrd_current(), pool->owner))
+        return pool->num_threads;
+    return SIZE_MAX;
+}
+
+static bool thrd_pool_take(thrd_pool_t *pool, size_t home, job_t *job) {
+    size_t count = pool->num_threads + 2;
+    if (home < count && job_deque_pop(&pool->deques[home], job))
+        return true;
+    size_t first = home < count ? home + 1 : 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t victim = (first + i) % count;
+        if (victim != home && job_deque_steal(&pool->deques[victim], job))
+            return true;
+    }
+    return false;
 }
 
-static void job_queue_shutdown(job_queue_t *queue) {
-    if (!queue)
-        return;
-
-    mtx_lock(&queue->mutex);
-    queue->shutdown = true;
-    mtx_unlock(&queue->mutex);
-
-    cnd_broadcast(&queue->not_empty);
+static void thrd_pool_run(thrd_pool_t *pool, job_t *job) {
+    atomic_fetch_sub(&pool->queued, 1);
+    atomic_fetch_add(&pool->active_threads, 1);
+    job->function(job->arg);
+    atomic_fetch_sub(&pool->active_threads, 1);
+    atomic_fetch_sub(&pool->pending, 1);
 }
 
 static int worker_thread(void *arg) {
     thrd_pool_t *pool = (thrd_pool_t*)arg;
+    thrd_pool_self.pool = pool;
+    thrd_pool_self.index = atomic_fetch_add(&pool->started, 1);
     job_t job;
-    while (!atomic_load(&pool->shutdown))
-        if (job_queue_dequeue(&pool->job_queue, &job) == thrd_success) {
-            // Increment active thread count
-            atomic_fetch_add(&pool->active_threads, 1);
-
-            // Execute the job
-            if (job.function)
-                job.function(job.arg);
-
-            // Decrement active thread count
-            atomic_fetch_sub(&pool->active_threads, 1);
-
-            // Signal if all threads are idle
-            if (atomic_load(&pool->active_threads) == 0) {
-                mtx_lock(&pool->pool_mutex);
-                cnd_signal(&pool->all_threads_idle);
-                mtx_unlock(&pool->pool_mutex);
-            }
+    unsigned int spins = 0;
+    while (!atomic_load(&pool->shutdown)) {
+        if (thrd_pool_take(pool, thrd_pool_self.index, &job)) {
+            thrd_pool_run(pool, &job);
+            spins = 0;
+            continue;
         }
+        if (++spins < THRD_POOL_SPIN_COUNT) {
+            thrd_yield();
+            continue;
+        }
+        // Nothing left to steal, sleep until more work is submitted
+        atomic_fetch_add(&pool->sleepers, 1);
+        mtx_lock(&pool->pool_mutex);
+        while (!atomic_load(&pool->queued) && !atomic_load(&pool->shutdown))
+            cnd_wait(&pool->work_available, &pool->pool_mutex);
+        mtx_unlock(&pool->pool_mutex);
+        atomic_fetch_sub(&pool->sleepers, 1);
+        spins = 0;
+    }
     return 0;
 }
 
+static void thrd_pool_free(thrd_pool_t *pool, size_t num_deques) {
+    for (size_t i = 0; i < num_deques; i++)
+        job_deque_destroy(&pool->deques[i]);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
 thrd_pool_t* thrd_pool_create(size_t num_threads, size_t max_queue_size) {
     if (num_threads == 0)
         return NULL;
@@ -1340,33 +1368,44 @@ thrd_pool_t* thrd_pool_create(size_t num_threads, size_t max_queue_size) {
         return NULL;
 
     pool->threads = (thrd_t*)malloc(sizeof(thrd_t) * num_threads);
-    if (!pool->threads) {
+    pool->deques = (job_deque_t*)malloc(sizeof(job_deque_t) * (num_threads + 2));
+    if (!pool->threads || !pool->deques) {
+        free(pool->threads);
+        free(pool->deques);
         free(pool);
         return NULL;
     }
 
+    for (size_t i = 0; i < num_threads + 2; i++)
+        if (job_deque_init(&pool->deques[i], max_queue_size ? max_queue_size : THRD_POOL_DEQUE_SIZE) != thrd_success) {
+            thrd_pool_free(pool, i);
+            return NULL;
+        }
+
     pool->num_threads = num_threads;
+    pool->owner = thrd_current();
     atomic_store(&pool->shutdown, false);
+    atomic_store(&pool->started, 0);
     atomic_store(&pool->active_threads, 0);
+    atomic_store(&pool->pending, 0);
+    atomic_store(&pool->queued, 0);
+    atomic_store(&pool->sleepers, 0);
 
-    if (job_queue_init(&pool->job_queue, max_queue_size) != thrd_success) {
-        free(pool->threads);
-        free(pool);
+    if (mtx_init(&pool->pool_mutex, mtx_plain) != thrd_success) {
+        thrd_pool_free(pool, num_threads + 2);
         return NULL;
     }
 
-    if (mtx_init(&pool->pool_mutex, mtx_plain) != thrd_success) {
-        job_queue_destroy(&pool->job_queue);
-        free(pool->threads);
-        free(pool);
+    if (cnd_init(&pool->work_available) != thrd_success) {
+        mtx_destroy(&pool->pool_mutex);
+        thrd_pool_free(pool, num_threads + 2);
         return NULL;
     }
 
-    if (cnd_init(&pool->all_threads_idle) != thrd_success) {
+    if (mtx_init(&pool->inject_mutex, mtx_plain) != thrd_success) {
+        cnd_destroy(&pool->work_available);
         mtx_destroy(&pool->pool_mutex);
-        job_queue_destroy(&pool->job_queue);
-        free(pool->threads);
-        free(pool);
+        thrd_pool_free(pool, num_threads + 2);
         return NULL;
     }
 
@@ -1375,16 +1414,17 @@ thrd_pool_t* thrd_pool_create(size_t num_threads, size_t max_queue_size) {
         if (thrd_create(&pool->threads[i], worker_thread, pool) != thrd_success) {
             // Cleanup on failure
             atomic_store(&pool->shutdown, true);
-            job_queue_shutdown(&pool->job_queue);
+            mtx_lock(&pool->pool_mutex);
+            cnd_broadcast(&pool->work_available);
+            mtx_unlock(&pool->pool_mutex);
 
             for (size_t j = 0; j < i; j++)
                 thrd_join(pool->threads[j], NULL);
 
-            cnd_destroy(&pool->all_threads_idle);
+            mtx_destroy(&pool->inject_mutex);
+            cnd_destroy(&pool->work_available);
             mtx_destroy(&pool->pool_mutex);
-            job_queue_destroy(&pool->job_queue);
-            free(pool->threads);
-            free(pool);
+            thrd_pool_free(pool, num_threads + 2);
             return NULL;
         }
 
@@ -1403,16 +1443,51 @@ int thrd_pool_submit(thrd_pool_t *pool, void (*function)(void*), void *arg, void
         .arg = arg,
         .cleanup = cleanup
     };
-    return job_queue_enqueue(&pool->job_queue, job);
+
+    atomic_fetch_add(&pool->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    size_t home = thrd_pool_home(pool);
+    bool pushed;
+    if (home == SIZE_MAX) {
+        mtx_lock(&pool->inject_mutex);
+        pushed = job_deque_push(&pool->deques[pool->num_threads + 1], job);
+        mtx_unlock(&pool->inject_mutex);
+    } else
+        pushed = job_deque_push(&pool->deques[home], job);
+
+    if (!pushed) {
+        // Deque is full, run the job here instead of dropping it
+        thrd_pool_run(pool, &job);
+        return thrd_success;
+    }
+
+    if (atomic_load(&pool->sleepers)) {
+        mtx_lock(&pool->pool_mutex);
+        cnd_signal(&pool->work_available);
+        mtx_unlock(&pool->pool_mutex);
+    }
+    return thrd_success;
 }
 
 void thrd_pool_wait(thrd_pool_t *pool) {
     if (!pool)
         return;
-    mtx_lock(&pool->pool_mutex);
-    while (pool->job_queue.size > 0 || atomic_load(&pool->active_threads) > 0)
-        cnd_wait(&pool->all_threads_idle, &pool->pool_mutex);
-    mtx_unlock(&pool->pool_mutex);
+    size_t home = thrd_pool_home(pool);
+    job_t job;
+    while (atomic_load(&pool->pending) > 0) {
+        if (thrd_pool_take(pool, home, &job))
+            thrd_pool_run(pool, &job);
+        else
+            thrd_yield();
+    }
+}
+
+bool thrd_pool_help(thrd_pool_t *pool) {
+    job_t job;
+    if (!pool || !thrd_pool_take(pool, thrd_pool_home(pool), &job))
+        return false;
+    thrd_pool_run(pool, &job);
+    return true;
 }
 
 void thrd_pool_destroy(thrd_pool_t *pool) {
@@ -1420,16 +1495,17 @@ void thrd_pool_destroy(thrd_pool_t *pool) {
         return;
     // Signal shutdown
     atomic_store(&pool->shutdown, true);
-    job_queue_shutdown(&pool->job_queue);
+    mtx_lock(&pool->pool_mutex);
+    cnd_broadcast(&pool->work_available);
+    mtx_unlock(&pool->pool_mutex);
     // Wait for all threads to finish
     for (size_t i = 0; i < pool->num_threads; i++)
         thrd_join(pool->threads[i], NULL);
     // Cleanup
-    job_queue_destroy(&pool->job_queue);
-    cnd_destroy(&pool->all_threads_idle);
+    mtx_destroy(&pool->inject_mutex);
+    cnd_destroy(&pool->work_available);
     mtx_destroy(&pool->pool_mutex);
-    free(pool->threads);
-    free(pool);
+    thrd_pool_free(pool, pool->num_threads + 2);
 }
 
 size_t thrd_pool_get_thread_count(thrd_pool_t *pool) {
@@ -1441,12 +1517,7 @@ size_t thrd_pool_get_active_count(thrd_pool_t *pool) {
 }
 
 size_t thrd_pool_get_queue_size(thrd_pool_t *pool) {
-    if (!pool)
-        return 0;
-    mtx_lock(&pool->job_queue.mutex);
-    size_t size = pool->job_queue.size;
-    mtx_unlock(&pool->job_queue.mutex);
-    return size;
+    return pool ? atomic_load(&pool->queued) : 0;
 }
 
 unsigned int thread_hardware_concurrency(void) {
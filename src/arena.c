@@ -0,0 +1,199 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cccp.h"
+
+// Size classes are powers of two from 4 KiB, anything bigger than the last
+// class isn't worth recycling and fails
+#define ARENA_MIN_CLASS 12
+#define ARENA_CLASS_COUNT 20
+// Frames a recycled block can sit unused before it's given back
+#define ARENA_IDLE_FRAMES 300
+
+// Lives in the first cache line of its own memory, images go after it
+typedef struct CCCP_ArenaBlock {
+    struct CCCP_ArenaBlock *next;
+    uint64_t last_used;
+} CCCP_ArenaBlock;
+
+struct CCCP_FrameArena {
+    // Same arrangement as the thread pool, memory must always be released by
+    // the module that allocated it
+    void*(*alloc)(size_t);
+    void(*release)(void*);
+    mtx_t lock;
+    CCCP_ArenaBlock *used[ARENA_CLASS_COUNT];
+    CCCP_ArenaBlock *unused[ARENA_CLASS_COUNT];
+    uint64_t frame;
+    size_t in_use, retained;
+};
+
+static CCCP_FrameArena *current_arena = NULL;
+// Begin/End only count, the allocator is swapped in just around the
+// functions that hand back new surfaces so nothing else (glyph caches,
+// shader graph outputs) ends up in memory that's reused next frame
+static int arena_depth = 0;
+
+CCCP_FrameArena* CCCP_NewFrameArena(void) {
+    static_assert(sizeof(CCCP_ArenaBlock) <= BITMAP_ALIGNMENT, "arena block header too large");
+    CCCP_FrameArena *arena = calloc(1, sizeof(CCCP_FrameArena));
+    if (!arena)
+        return NULL;
+    arena->alloc = bitmap_alloc;
+    arena->release = bitmap_free;
+    if (mtx_init(&arena->lock, mtx_plain) != thrd_success) {
+        free(arena);
+        return NULL;
+    }
+    return arena;
+}
+
+static void CCCP_ReleaseBlocks(CCCP_FrameArena *arena, CCCP_ArenaBlock *block) {
+    while (block) {
+        CCCP_ArenaBlock *next = block->next;
+        arena->release(block);
+        block = next;
+    }
+}
+
+void CCCP_DestroyFrameArena(CCCP_FrameArena *arena) {
+    if (!arena)
+        return;
+    if (current_arena == arena) {
+        current_arena = NULL;
+        arena_depth = 0;
+    }
+    for (int i = 0; i < ARENA_CLASS_COUNT; i++) {
+        CCCP_ReleaseBlocks(arena, arena->used[i]);
+        CCCP_ReleaseBlocks(arena, arena->unused[i]);
+    }
+    mtx_destroy(&arena->lock);
+    free(arena);
+}
+
+void CCCP_SetFrameArena(CCCP_FrameArena *arena) {
+    current_arena = arena;
+}
+
+CCCP_FrameArena* CCCP_GetFrameArena(void) {
+    return current_arena;
+}
+
+static int CCCP_ArenaClass(size_t size) {
+    int index = 0;
+    while (index < ARENA_CLASS_COUNT && ((size_t)1 << (index + ARENA_MIN_CLASS)) < size)
+        index++;
+    return index;
+}
+
+static void* CCCP_ArenaAlloc(size_t size, void *userdata) {
+    CCCP_FrameArena *arena = userdata;
+    int index = CCCP_ArenaClass(BITMAP_ALIGNMENT + size);
+    if (index == ARENA_CLASS_COUNT)
+        return NULL;
+    size_t bytes = (size_t)1 << (index + ARENA_MIN_CLASS);
+    mtx_lock(&arena->lock);
+    CCCP_ArenaBlock *block = arena->unused[index];
+    if (block)
+        arena->unused[index] = block->next;
+    else if ((block = arena->alloc(bytes)))
+        arena->retained += bytes;
+    if (block) {
+        block->last_used = arena->frame;
+        block->next = arena->used[index];
+        arena->used[index] = block;
+        arena->in_use += bytes;
+    }
+    mtx_unlock(&arena->lock);
+    return block ? (uint8_t*)block + BITMAP_ALIGNMENT : NULL;
+}
+
+bool CCCP_BeginFrameArena(void) {
+    if (!current_arena)
+        return false;
+    arena_depth++;
+    return true;
+}
+
+void CCCP_EndFrameArena(void) {
+    if (arena_depth > 0)
+        arena_depth--;
+}
+
+bool CCCP_EnterFrameArena(void) {
+    if (!arena_depth || !current_arena)
+        return false;
+    bitmap_set_allocator(CCCP_ArenaAlloc, current_arena);
+    return true;
+}
+
+void CCCP_LeaveFrameArena(void) {
+    bitmap_set_allocator(NULL, NULL);
+}
+
+CCCP_Surface CCCP_TempSurface(unsigned int w, unsigned int h, color_t clearColor) {
+    if (!current_arena || !w || !h)
+        return NULL;
+    CCCP_Surface surface = bitmap_wrap(CCCP_ArenaAlloc(BITMAP_HEADER_SIZE + (size_t)w * h * sizeof(color_t), current_arena), w, h);
+    if (surface)
+        CCCP_ClearSurface(surface, clearColor);
+    return surface;
+}
+
+void CCCP_ResetFrameArena(CCCP_FrameArena *arena) {
+    if (!arena)
+        return;
+    mtx_lock(&arena->lock);
+    arena->frame++;
+    for (int i = 0; i < ARENA_CLASS_COUNT; i++) {
+        size_t bytes = (size_t)1 << (i + ARENA_MIN_CLASS);
+        // Whatever the scene stopped asking for drains away, so one big
+        // frame doesn't pin its memory for the rest of the run
+        CCCP_ArenaBlock **link = &arena->unused[i];
+        while (*link) {
+            CCCP_ArenaBlock *block = *link;
+            if (arena->frame - block->last_used > ARENA_IDLE_FRAMES) {
+                *link = block->next;
+                arena->release(block);
+                arena->retained -= bytes;
+            } else
+                link = &block->next;
+        }
+        while (arena->used[i]) {
+            CCCP_ArenaBlock *block = arena->used[i];
+            arena->used[i] = block->next;
+            block->next = arena->unused[i];
+            arena->unused[i] = block;
+        }
+    }
+    arena->in_use = 0;
+    mtx_unlock(&arena->lock);
+}
+
+bool CCCP_GetFrameArenaStats(size_t *inUse, size_t *retained) {
+    if (!current_arena)
+        return false;
+    mtx_lock(&current_arena->lock);
+    if (inUse)
+        *inUse = current_arena->in_use;
+    if (retained)
+        *retained = current_arena->retained;
+    mtx_unlock(&current_arena->lock);
+    return true;
+}
@@ -22,6 +22,10 @@
 #define PAUL_IMPLEMENTATION
 #include "cccp.h"
 #include "./hashtable.c"
+#include "./pool.c"
+#include "./pacing.c"
+#include "./record.c"
 #include "./surface.c"
+#include "./arena.c"
 #include "./shader.c"
 #include "./audio.c"
\ No newline at end of file
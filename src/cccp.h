@@ -184,11 +184,13 @@ typedef struct CCCP_State CCCP_State;
  * @constant MouseScrollEvent Mouse scroll event.
  * @constant ResizedEvent Window resize event.
  * @constant FocusEvent Window focus event.
+ * @constant FramebufferResizedEvent The framebuffer passed to tick changed size (dynamic resolution).
  */
 typedef enum {
 #define X(NAME, ARGS) NAME##Event,
     CCCP_CALLBACKS
 #undef X
+    FramebufferResizedEvent
 } CCCP_EventType;
 
 /*!
@@ -215,6 +217,10 @@ typedef enum {
  * @field window.size Window dimensions.
  * @field window.size.width Window width.
  * @field window.size.height Window height.
+ * @field framebuffer Framebuffer-related event data.
+ * @field framebuffer.width New framebuffer width.
+ * @field framebuffer.height New framebuffer height.
+ * @field framebuffer.scale New framebuffer size relative to the requested size.
  * @field type The type of event.
  */
 typedef struct {
@@ -240,31 +246,261 @@ typedef struct {
             unsigned int width, height;
         } size;
     } window;
+    struct {
+        unsigned int width, height;
+        float scale;
+    } framebuffer;
     CCCP_EventType type;
 } CCCP_Event;
 
 typedef bitmap_t CCCP_Surface;
 typedef color_t CCCP_Color;
 
+/*!
+ * @struct CCCP_ShaderUniforms
+ * @brief Per-frame values shared by every pixel of a shader pass.
+ * @field time Seconds since the program started.
+ * @field delta Seconds since the previous frame.
+ * @field frame Index of the current frame.
+ * @field mouse Mouse position in window coordinates.
+ * @field resolution Resolution of the surface being shaded.
+ * @discussion Filled once per CCCP_ApplyShader call and passed to the shader by const pointer.
+ */
+typedef struct {
+    float time;
+    float delta;
+    uint64_t frame;
+    vec2 mouse;
+    vec2 resolution;
+} CCCP_ShaderUniforms;
+
 /*!
  * @typedef CCCP_ShaderFunc
  * @brief Function pointer type for shader functions.
  * @param fragcoord Fragment coordinates (vec2).
- * @param resolution Surface resolution (vec2).
- * @param time Current time (float).
+ * @param uniforms Per-frame uniforms (time, resolution, etc).
  * @param userdata User-defined data pointer.
  * @return Color value (vec4).
  */
-typedef vec4(*CCCP_ShaderFunc)(vec2, vec2, float, void*);
+typedef vec4(*CCCP_ShaderFunc)(vec2, const CCCP_ShaderUniforms*, void*);
+
+/*!
+ * @typedef vec8
+ * @brief Eight float lanes, used for 8-wide shader packets.
+ */
+typedef float vec8 vector(8);
+
+/*!
+ * @typedef ivec4
+ * @brief Four signed 32-bit integer lanes.
+ */
+typedef int32_t ivec4 vector(4);
+
+/*!
+ * @typedef ivec8
+ * @brief Eight signed 32-bit integer lanes.
+ */
+typedef int32_t ivec8 vector(8);
+
+/*!
+ * @typedef uvec4
+ * @brief Four unsigned 32-bit integer lanes.
+ */
+typedef uint32_t uvec4 vector(4);
+
+/*!
+ * @typedef uvec8
+ * @brief Eight unsigned 32-bit integer lanes.
+ */
+typedef uint32_t uvec8 vector(8);
+
+/*!
+ * @function CCCP_PackColor
+ * @brief Converts a normalized float color to a packed 8-bit color.
+ * @param color Color value (vec4), each channel 0.0 to 1.0.
+ * @return The clamped color_t.
+ * @discussion All four channels are clamped, scaled and rounded at once. NaN channels become 0.
+ */
+static inline color_t CCCP_PackColor(vec4 color) {
+    // Clamped as floats, converting NaN or out of range values to int is undefined
+    ivec4 above = color > 0.f, below = color < 1.f;
+    color = (vec4)(((ivec4)color & above & below) | (above & ~below & 0x3F800000));
+    uvec4 i = __builtin_convertvector(color * 255.f + .5f, uvec4);
+    return (color_t){ .r = (uint8_t)i[0], .g = (uint8_t)i[1], .b = (uint8_t)i[2], .a = (uint8_t)i[3] };
+}
+
+/*!
+ * @struct CCCP_ColorPacket4
+ * @brief Colors for a packet of 4 pixels, one lane per pixel.
+ * @field r Red channels (0.0 to 1.0).
+ * @field g Green channels (0.0 to 1.0).
+ * @field b Blue channels (0.0 to 1.0).
+ * @field a Alpha channels (0.0 to 1.0).
+ */
+typedef struct {
+    vec4 r, g, b, a;
+} CCCP_ColorPacket4;
+
+/*!
+ * @struct CCCP_ColorPacket8
+ * @brief Colors for a packet of 8 pixels, one lane per pixel.
+ * @field r Red channels (0.0 to 1.0).
+ * @field g Green channels (0.0 to 1.0).
+ * @field b Blue channels (0.0 to 1.0).
+ * @field a Alpha channels (0.0 to 1.0).
+ */
+typedef struct {
+    vec8 r, g, b, a;
+} CCCP_ColorPacket8;
+
+/*!
+ * @typedef CCCP_ShaderFunc4
+ * @brief Function pointer type for shaders that shade 4 horizontally adjacent pixels at once.
+ * @param x Fragment X coordinates, one lane per pixel (vec4).
+ * @param y Fragment Y coordinates, one lane per pixel (vec4).
+ * @param uniforms Per-frame uniforms (time, resolution, etc).
+ * @param userdata User-defined data pointer.
+ * @return Colors for the whole packet (CCCP_ColorPacket4).
+ * @discussion Lanes past the right edge of the surface are shaded but discarded.
+ */
+typedef CCCP_ColorPacket4(*CCCP_ShaderFunc4)(vec4, vec4, const CCCP_ShaderUniforms*, void*);
+
+/*!
+ * @typedef CCCP_ShaderFunc8
+ * @brief Function pointer type for shaders that shade 8 horizontally adjacent pixels at once.
+ * @param x Fragment X coordinates, one lane per pixel (vec8).
+ * @param y Fragment Y coordinates, one lane per pixel (vec8).
+ * @param uniforms Per-frame uniforms (time, resolution, etc).
+ * @param userdata User-defined data pointer.
+ * @return Colors for the whole packet (CCCP_ColorPacket8).
+ * @discussion Lanes past the right edge of the surface are shaded but discarded.
+ */
+typedef CCCP_ColorPacket8(*CCCP_ShaderFunc8)(vec8, vec8, const CCCP_ShaderUniforms*, void*);
+
+/*!
+ * @struct CCCP_ShaderTile
+ * @brief A clipped region of a surface handed to a tile shader.
+ * @discussion Coordinates are relative to the view being shaded, which is the whole surface unless the pass
+ * came from CCCP_ApplyShaderView. Pixel (x, y) is pixels[y * stride + x].
+ * @field surface The surface being shaded.
+ * @field pixels Top left pixel of the view being shaded.
+ * @field stride Distance in pixels between the start of each row.
+ * @field x Left edge of the tile.
+ * @field y Top edge of the tile.
+ * @field w Width of the tile.
+ * @field h Height of the tile.
+ * @field uniforms Per-frame uniforms (time, resolution, etc).
+ * @field userdata User-defined data pointer.
+ */
+typedef struct {
+    CCCP_Surface surface;
+    color_t *pixels;
+    int stride;
+    int x, y, w, h;
+    const CCCP_ShaderUniforms *uniforms;
+    void *userdata;
+} CCCP_ShaderTile;
+
+/*!
+ * @typedef CCCP_ShaderTileFunc
+ * @brief Function pointer type for shaders that shade a whole tile per call.
+ * @param tile The region of the surface to shade.
+ * @discussion These are normally generated by CCCP_DEFINE_SHADER rather than written by hand.
+ */
+typedef void(*CCCP_ShaderTileFunc)(const CCCP_ShaderTile*);
+
+/*!
+ * @define CCCP_DEFINE_SHADER
+ * @brief Defines a shader along with a tile worker that has the shader body inlined.
+ * @param NAME Name of the shader function.
+ * @param FRAGCOORD Name of the fragment coordinate parameter (vec2).
+ * @param UNIFORMS Name of the uniforms parameter (const CCCP_ShaderUniforms*).
+ * @param USERDATA Name of the userdata parameter (void*).
+ * @discussion The shader body follows the macro like a regular function body, e.g.
+ *             CCCP_DEFINE_SHADER(plasma, fc, u, ud) { return (vec4){fc.x / u->resolution.x, fc.y / u->resolution.y, 0.f, 1.f}; }
+ *             NAME is still a regular CCCP_ShaderFunc, pass it to CCCP_NewDefinedShader to use the specialized worker.
+ */
+#define CCCP_DEFINE_SHADER(NAME, FRAGCOORD, UNIFORMS, USERDATA)                                  \
+    static inline __attribute__((always_inline)) vec4 NAME##_body(vec2, const CCCP_ShaderUniforms*, void*); \
+    static vec4 NAME(vec2 fragcoord, const CCCP_ShaderUniforms *uniforms, void *userdata) {     \
+        return NAME##_body(fragcoord, uniforms, userdata);                                      \
+    }                                                                                           \
+    static void NAME##_tile(const CCCP_ShaderTile *tile) {                                      \
+        const CCCP_ShaderUniforms *uniforms = tile->uniforms;                                   \
+        void *userdata = tile->userdata;                                                        \
+        for (int y = tile->y; y < tile->y + tile->h; ++y) {                                     \
+            color_t *row = tile->pixels + y * tile->stride;                                     \
+            for (int x = tile->x; x < tile->x + tile->w; ++x)                                   \
+                row[x] = CCCP_PackColor(NAME##_body((vec2){(float)x + 0.5f, (float)y + 0.5f}, uniforms, userdata)); \
+        }                                                                                       \
+    }                                                                                           \
+    static inline __attribute__((always_inline)) vec4 NAME##_body(vec2 FRAGCOORD, const CCCP_ShaderUniforms *UNIFORMS, void *USERDATA)
+
+/*!
+ * @define CCCP_NewDefinedShader
+ * @brief Creates a shader from a CCCP_DEFINE_SHADER definition using its specialized tile worker.
+ * @param NAME Name given to CCCP_DEFINE_SHADER.
+ * @param NUM_THREADS Number of threads to use (0 = hardware concurrency).
+ */
+#define CCCP_NewDefinedShader(NAME, NUM_THREADS) CCCP_NewTileShader(NAME, NAME##_tile, NUM_THREADS)
+
+/*!
+ * @typedef CCCP_Fence
+ * @brief Handle to an asynchronous shader pass, 0 is never a pending fence.
+ */
+typedef uint64_t CCCP_Fence;
+
+#ifndef CCCP_MAX_PASS_INPUTS
+#define CCCP_MAX_PASS_INPUTS 8
+#endif
+
+/*!
+ * @typedef CCCP_ShaderGraph
+ * @brief Opaque type for a set of shader passes that feed into each other.
+ */
+typedef struct CCCP_ShaderGraph CCCP_ShaderGraph;
+
+/*!
+ * @struct CCCP_PassInput
+ * @brief Describes a surface a shader pass reads from.
+ * @field pass Index of the pass whose output is read.
+ * @field previous Read that pass's output from the previous frame instead of this one.
+ * @discussion Inputs from the current frame must come from a pass added earlier, previous frame inputs can come from any pass.
+ */
+typedef struct {
+    int pass;
+    bool previous;
+} CCCP_PassInput;
+
+/*!
+ * @struct CCCP_ShaderPass
+ * @brief Passed to a shader graph pass's shader function as its userdata.
+ * @field inputs Input surfaces, in the order they were declared.
+ * @field input_count Number of input surfaces.
+ * @field previous This pass's own output from the previous frame.
+ * @field userdata User-defined data given when the pass was added.
+ */
+typedef struct {
+    CCCP_Surface inputs[CCCP_MAX_PASS_INPUTS];
+    int input_count;
+    CCCP_Surface previous;
+    void *userdata;
+} CCCP_ShaderPass;
 
 /*!
  * @struct CCCP_Shader
  * @brief Represents a shader for surface processing.
  * @field func Pointer to the shader function.
- * @field thread_count Number of threads to use (0 = use hardware concurrency).
+ * @field tile Pointer to a tile shader function (used instead of every other function if set).
+ * @field func4 Pointer to a 4-wide packet shader function (used instead of func if set).
+ * @field func8 Pointer to an 8-wide packet shader function (used instead of func4 and func if set).
+ * @field thread_count Most threads a pass may run on (0 = use hardware concurrency). Limits how many of the runtime's workers are given the pass, the pool itself is never resized.
  */
 typedef struct {
     CCCP_ShaderFunc func;
+    CCCP_ShaderTileFunc tile;
+    CCCP_ShaderFunc4 func4;
+    CCCP_ShaderFunc8 func8;
     int thread_count; // 0 = use hardware concurrency
 } CCCP_Shader;
 
@@ -317,6 +553,32 @@ typedef struct CCCP_AudioContext {
     CCCP_HashTable *music;
 } CCCP_AudioContext;
 
+/*!
+ * @enum CCCP_RedrawMode
+ * @brief How much of the framebuffer a scene draws each frame.
+ * @constant REDRAW_CLEAR The runtime clears the framebuffer to clearColor before every tick.
+ * @constant REDRAW_FULL The scene covers every pixel itself, the clear is skipped.
+ * @constant REDRAW_PARTIAL The framebuffer keeps the previous frame, the scene only draws what changed and only those regions are presented.
+ */
+typedef enum {
+    REDRAW_CLEAR = 0,
+    REDRAW_FULL,
+    REDRAW_PARTIAL
+} CCCP_RedrawMode;
+
+/*!
+ * @enum CCCP_TickResult
+ * @brief What a scene's tick function asks the runtime to do next.
+ * @constant TICK_QUIT Exit the program.
+ * @constant TICK_CONTINUE Tick again next frame.
+ * @constant TICK_IDLE Present this frame, then stop ticking until an event arrives, idleTimeout passes or the library is rebuilt.
+ */
+typedef enum {
+    TICK_QUIT = 0,
+    TICK_CONTINUE,
+    TICK_IDLE
+} CCCP_TickResult;
+
 /*!
  * @struct CCCP_Scene
  * @brief Configuration structure for a scene in the application.
@@ -325,12 +587,15 @@ typedef struct CCCP_AudioContext {
  * @field windowTitle Window title string.
  * @field clearColor Background clear color.
  * @field targetFPS Target frames per second.
+ * @field dynamicResolution Shrink or grow the framebuffer to keep up with targetFPS (see FramebufferResizedEvent).
+ * @field redraw How the framebuffer is prepared before each tick (see CCCP_RedrawMode).
+ * @field idleTimeout Seconds a scene that returned TICK_IDLE sleeps before ticking anyway, 0 waits for an event.
  * @field init Function called to initialize the scene state.
  * @field deinit Function called to deinitialize the scene state.
  * @field reload Function called when the scene is reloaded.
  * @field unload Function called when the scene is unloaded.
  * @field event Function called to handle events.
- * @field tick Function called each frame to update the scene.
+ * @field tick Function called each frame to update the scene, returns a CCCP_TickResult.
  */
 typedef struct {
     int windowWidth;
@@ -338,6 +603,9 @@ typedef struct {
     const char *windowTitle;
     color_t clearColor;
     int targetFPS;
+    int dynamicResolution;
+    CCCP_RedrawMode redraw;
+    double idleTimeout;
     CCCP_State*(*init)(CCCP_Surface, CCCP_AudioContext*);
     void(*deinit)(CCCP_State*, CCCP_AudioContext*);
     void(*reload)(CCCP_State*, CCCP_AudioContext*);
@@ -395,6 +663,7 @@ void CCCP_DestroySurface(CCCP_Surface surface);
 /*!
  * @function CCCP_SurfaceWidth
  * @brief Gets the width of a surface.
+ * @discussion The padding of surfaces made by CCCP_NewPaddedSurface isn't counted.
  * @param surface The surface.
  * @return The width of the surface.
  */
@@ -440,6 +709,7 @@ color_t CCCP_GetPixel(CCCP_Surface surface, int x, int y);
 /*!
  * @function CCCP_BlitSurface
  * @brief Blits one surface onto another at the specified position.
+ * @discussion Anything outside either surface is clipped, rows are copied whole.
  * @param dest The destination surface.
  * @param src The source surface.
  * @param x X coordinate on the destination surface.
@@ -450,6 +720,7 @@ void CCCP_BlitSurface(CCCP_Surface dest, CCCP_Surface src, int x, int y);
 /*!
  * @function CCCP_BlitSurfaceRect
  * @brief Blits a rectangular region from one surface to another.
+ * @discussion The rectangle is clipped against both surfaces, src and dest may be the same surface.
  * @param dest The destination surface.
  * @param src The source surface.
  * @param srcX X coordinate of the source rectangle.
@@ -461,6 +732,102 @@ void CCCP_BlitSurface(CCCP_Surface dest, CCCP_Surface src, int x, int y);
  */
 void CCCP_BlitSurfaceRect(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY);
 
+/*!
+ * @enum CCCP_BlendMode
+ * @brief How CCCP_BlitSurfaceMode combines each source pixel with the destination.
+ * @discussion Every mode but BLEND_ALPHA matches the paul_color function of the same name, with the
+ * destination as the base layer, and combines alpha as 255 - (255 - a) * (255 - b) / 255.
+ * @constant BLEND_ALPHA Straight alpha source-over, like color_alpha_blend.
+ * @constant BLEND_MULTIPLY Darkens, like color_multiply.
+ * @constant BLEND_SCREEN Lightens, like color_screen.
+ * @constant BLEND_OVERLAY Multiply or screen depending on the destination, like color_overlay.
+ * @constant BLEND_SOFT_LIGHT Like color_soft_light.
+ * @constant BLEND_HARD_LIGHT Multiply or screen depending on the source, like color_hard_light.
+ * @constant BLEND_COLOR_DODGE Like color_color_dodge.
+ * @constant BLEND_COLOR_BURN Like color_color_burn.
+ * @constant BLEND_DARKEN Per channel minimum, like color_darken.
+ * @constant BLEND_LIGHTEN Per channel maximum, like color_lighten.
+ * @constant BLEND_DIFFERENCE Absolute difference, like color_difference.
+ * @constant BLEND_EXCLUSION Like color_exclusion.
+ */
+typedef enum {
+    BLEND_ALPHA = 0,
+    BLEND_MULTIPLY,
+    BLEND_SCREEN,
+    BLEND_OVERLAY,
+    BLEND_SOFT_LIGHT,
+    BLEND_HARD_LIGHT,
+    BLEND_COLOR_DODGE,
+    BLEND_COLOR_BURN,
+    BLEND_DARKEN,
+    BLEND_LIGHTEN,
+    BLEND_DIFFERENCE,
+    BLEND_EXCLUSION
+} CCCP_BlendMode;
+
+/*!
+ * @function CCCP_BlitSurfaceMode
+ * @brief Blits one surface onto another, combining them with a blend mode.
+ * @discussion Clipped like CCCP_BlitSurface. Large blits are split into bands of rows on the runtime's thread pool
+ * and wait for those bands, so don't call this from inside a shader or pool job. src and dest may be the same
+ * surface, even overlapping, those blits aren't split.
+ * @param dest The destination surface.
+ * @param src The source surface.
+ * @param x X coordinate on the destination surface.
+ * @param y Y coordinate on the destination surface.
+ * @param mode How to combine the pixels.
+ */
+void CCCP_BlitSurfaceMode(CCCP_Surface dest, CCCP_Surface src, int x, int y, CCCP_BlendMode mode);
+
+/*!
+ * @function CCCP_BlitSurfaceRectMode
+ * @brief Blits a rectangular region from one surface onto another, combining them with a blend mode.
+ * @param dest The destination surface.
+ * @param src The source surface, may overlap the destination region.
+ * @param srcX X coordinate of the source rectangle.
+ * @param srcY Y coordinate of the source rectangle.
+ * @param srcW Width of the source rectangle.
+ * @param srcH Height of the source rectangle.
+ * @param destX X coordinate on the destination surface.
+ * @param destY Y coordinate on the destination surface.
+ * @param mode How to combine the pixels.
+ */
+void CCCP_BlitSurfaceRectMode(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY, CCCP_BlendMode mode);
+
+/*!
+ * @function CCCP_BlitSurfaceBlend
+ * @brief Alpha blends one surface onto another at the specified position.
+ * @discussion Source-over on premultiplied colors, see CCCP_PremultiplySurface. Clipped like CCCP_BlitSurface.
+ * @param dest The destination surface.
+ * @param src The source surface, premultiplied.
+ * @param x X coordinate on the destination surface.
+ * @param y Y coordinate on the destination surface.
+ */
+void CCCP_BlitSurfaceBlend(CCCP_Surface dest, CCCP_Surface src, int x, int y);
+
+/*!
+ * @function CCCP_BlitSurfaceRectBlend
+ * @brief Alpha blends a rectangular region from one surface onto another.
+ * @discussion Source-over on premultiplied colors. src and dest may be the same surface, even overlapping.
+ * @param dest The destination surface.
+ * @param src The source surface, premultiplied.
+ * @param srcX X coordinate of the source rectangle.
+ * @param srcY Y coordinate of the source rectangle.
+ * @param srcW Width of the source rectangle.
+ * @param srcH Height of the source rectangle.
+ * @param destX X coordinate on the destination surface.
+ * @param destY Y coordinate on the destination surface.
+ */
+void CCCP_BlitSurfaceRectBlend(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY);
+
+/*!
+ * @function CCCP_PremultiplySurface
+ * @brief Multiplies every pixel's color by its alpha, in place.
+ * @discussion Surfaces loaded from files have straight alpha, do this once before blending them.
+ * @param surface The surface.
+ */
+void CCCP_PremultiplySurface(CCCP_Surface surface);
+
 /*!
  * @function CCCP_DrawLine
  * @brief Draws a line between two points.
@@ -551,9 +918,228 @@ CCCP_Surface CCCP_FlipSurface(CCCP_Surface surface, bool horizontal, bool vertic
  * @param w Width of the clip rectangle.
  * @param h Height of the clip rectangle.
  * @return A new clipped surface.
+ * @discussion This copies the pixels, use CCCP_ViewSurface to draw into part of a surface in place.
  */
 CCCP_Surface CCCP_ClipSurface(CCCP_Surface surface, int x, int y, int w, int h);
 
+/*!
+ * @struct CCCP_Rect
+ * @brief A rectangle in surface coordinates.
+ */
+typedef struct {
+    int x, y, w, h;
+} CCCP_Rect;
+
+// Edge length in pixels of the tiles dirty regions are tracked in
+#define CCCP_DIRTY_TILE 32
+
+/*!
+ * @function CCCP_TrackDirtyRegions
+ * @brief Turns dirty region tracking on or off for a surface.
+ * @discussion While tracking, the drawing functions, CCCP_ClearSurface and CCCP_ApplyShader record which CCCP_DIRTY_TILE sized tiles they touched. Surfaces start untracked, untracked surfaces only pay a NULL check per draw.
+ * @param surface The surface.
+ * @param enable Whether to track.
+ * @return false if the tracker couldn't be allocated.
+ */
+bool CCCP_TrackDirtyRegions(CCCP_Surface surface, bool enable);
+
+/*!
+ * @function CCCP_MarkDirty
+ * @brief Marks a region of a surface as changed.
+ * @discussion Only needed after writing pixels directly, the drawing functions mark what they touch. Does nothing on untracked surfaces.
+ * @param surface The surface.
+ * @param x X coordinate of the region.
+ * @param y Y coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+void CCCP_MarkDirty(CCCP_Surface surface, int x, int y, int w, int h);
+
+/*!
+ * @function CCCP_MarkSurfaceDirty
+ * @brief Marks the whole surface as changed.
+ * @param surface The surface.
+ */
+void CCCP_MarkSurfaceDirty(CCCP_Surface surface);
+
+/*!
+ * @function CCCP_ClearDirty
+ * @brief Forgets every recorded change, e.g. after presenting the surface.
+ * @param surface The surface.
+ */
+void CCCP_ClearDirty(CCCP_Surface surface);
+
+/*!
+ * @function CCCP_MergeDirty
+ * @brief Adds the changes recorded on one surface to another of the same size.
+ * @param dest The surface to add to.
+ * @param src The surface to read from.
+ */
+void CCCP_MergeDirty(CCCP_Surface dest, CCCP_Surface src);
+
+/*!
+ * @function CCCP_GetDirtyRects
+ * @brief Gets the changed regions of a surface as coalesced rectangles.
+ * @discussion Runs of dirty tiles are joined horizontally, then stacked with matching runs below them. When there would be more than max rectangles, their bounding box is returned instead.
+ * @param surface The surface.
+ * @param rects Array receiving the rectangles.
+ * @param max Capacity of the array.
+ * @return The number of rectangles, 0 if nothing changed, -1 if the surface isn't tracked.
+ */
+int CCCP_GetDirtyRects(CCCP_Surface surface, CCCP_Rect *rects, int max);
+
+// Enough rectangles for presenting, any more are cheaper sent as their bounding box
+#define CCCP_MAX_DIRTY_RECTS 32
+
+// Pixels in one cache line, the row width padded surfaces round up to
+#define CCCP_SURFACE_ROW_PIXELS (BITMAP_ALIGNMENT / (int)sizeof(color_t))
+
+/*!
+ * @struct CCCP_SurfaceView
+ * @brief A rectangle of a surface that can be drawn into like a surface of its own, without copying.
+ * @discussion Views are plain values, they don't own anything and are only valid while their surface is. Coordinates
+ * passed to the view functions are relative to the view and everything is clipped to its edges.
+ * @field surface The surface the view aliases.
+ * @field pixels The view's top left pixel, rows are stride pixels apart.
+ * @field x Left edge of the view on the surface.
+ * @field y Top edge of the view on the surface.
+ * @field w Width of the view, 0 for an empty view.
+ * @field h Height of the view, 0 for an empty view.
+ * @field stride Distance in pixels between the start of each row.
+ */
+typedef struct {
+    CCCP_Surface surface;
+    color_t *pixels;
+    int x, y, w, h;
+    int stride;
+} CCCP_SurfaceView;
+
+/*!
+ * @function CCCP_ViewSurface
+ * @brief Creates a view of a rectangle of a surface.
+ * @param surface The surface.
+ * @param x X coordinate of the rectangle.
+ * @param y Y coordinate of the rectangle.
+ * @param w Width of the rectangle.
+ * @param h Height of the rectangle.
+ * @return The view, clipped to the surface. Empty if nothing is left.
+ */
+CCCP_SurfaceView CCCP_ViewSurface(CCCP_Surface surface, int x, int y, int w, int h);
+
+/*!
+ * @function CCCP_SurfaceAsView
+ * @brief Creates a view of a whole surface.
+ * @param surface The surface.
+ * @return The view, empty if surface is NULL.
+ */
+CCCP_SurfaceView CCCP_SurfaceAsView(CCCP_Surface surface);
+
+/*!
+ * @function CCCP_NewPaddedSurface
+ * @brief Creates a surface whose rows all start on a cache line, and returns a view of it.
+ * @discussion Surface pixels are always BITMAP_ALIGNMENT aligned, but rows after the first only are when the width is a
+ * multiple of CCCP_SURFACE_ROW_PIXELS. Only surfaces made here are padded, rows of the surface behind the view are
+ * rounded up to that many pixels. The padding isn't content: it's left out of CCCP_SurfaceWidth, dirty tracking and
+ * every view of the surface, and spans reaching the right edge may fill into it to avoid a scalar tail. Functions
+ * that take the surface as a whole bitmap (CCCP_GetPixel, the transforms, CCCP_CopySurface) still see it, draw through
+ * the view instead. Free it with CCCP_DestroySurface(view.surface).
+ * @param w Width of the view.
+ * @param h Height of the view.
+ * @param clearColor Initial color of the whole surface, padding included.
+ * @return The view, empty on failure.
+ */
+CCCP_SurfaceView CCCP_NewPaddedSurface(unsigned int w, unsigned int h, color_t clearColor);
+
+/*!
+ * @function CCCP_SubView
+ * @brief Creates a view of a rectangle of another view.
+ * @param view The view.
+ * @param x X coordinate of the rectangle, relative to the view.
+ * @param y Y coordinate of the rectangle, relative to the view.
+ * @param w Width of the rectangle.
+ * @param h Height of the rectangle.
+ * @return The view, clipped to the original view. Empty if nothing is left.
+ */
+CCCP_SurfaceView CCCP_SubView(CCCP_SurfaceView view, int x, int y, int w, int h);
+
+/*!
+ * @function CCCP_ClearView
+ * @brief Fills a view with a color.
+ * @param view The view.
+ * @param color The color.
+ */
+void CCCP_ClearView(CCCP_SurfaceView view, color_t color);
+
+/*!
+ * @function CCCP_ViewSetPixel
+ * @brief Sets a pixel of a view.
+ * @param view The view.
+ * @param x X coordinate of the pixel.
+ * @param y Y coordinate of the pixel.
+ * @param color The color.
+ * @return false if the pixel is outside the view.
+ */
+bool CCCP_ViewSetPixel(CCCP_SurfaceView view, int x, int y, color_t color);
+
+/*!
+ * @function CCCP_ViewGetPixel
+ * @brief Gets a pixel of a view.
+ * @param view The view.
+ * @param x X coordinate of the pixel.
+ * @param y Y coordinate of the pixel.
+ * @return The color of the pixel, black if it is outside the view.
+ */
+color_t CCCP_ViewGetPixel(CCCP_SurfaceView view, int x, int y);
+
+/*!
+ * @function CCCP_ViewDrawLine
+ * @brief Draws a line between two points of a view, see CCCP_DrawLine.
+ */
+void CCCP_ViewDrawLine(CCCP_SurfaceView view, int x1, int y1, int x2, int y2, color_t color);
+
+/*!
+ * @function CCCP_ViewDrawRect
+ * @brief Draws a rectangle on a view, see CCCP_DrawRect.
+ */
+void CCCP_ViewDrawRect(CCCP_SurfaceView view, int x, int y, int w, int h, color_t color, bool filled);
+
+/*!
+ * @function CCCP_ViewDrawCircle
+ * @brief Draws a circle on a view, see CCCP_DrawCircle.
+ */
+void CCCP_ViewDrawCircle(CCCP_SurfaceView view, int x, int y, int radius, color_t color, bool filled);
+
+/*!
+ * @function CCCP_ViewDrawTriangle
+ * @brief Draws a triangle on a view, see CCCP_DrawTriangle.
+ */
+void CCCP_ViewDrawTriangle(CCCP_SurfaceView view, int x1, int y1, int x2, int y2, int x3, int y3, color_t color, bool filled);
+
+/*!
+ * @function CCCP_BlitView
+ * @brief Copies one view onto another, see CCCP_BlitSurface.
+ * @discussion The views may alias the same surface, even overlapping.
+ * @param dest The destination view.
+ * @param src The source view.
+ * @param x X coordinate on the destination view.
+ * @param y Y coordinate on the destination view.
+ */
+void CCCP_BlitView(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y);
+
+/*!
+ * @function CCCP_BlitViewBlend
+ * @brief Alpha blends one view onto another, see CCCP_BlitSurfaceBlend.
+ * @discussion The views may alias the same surface, even overlapping.
+ */
+void CCCP_BlitViewBlend(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y);
+
+/*!
+ * @function CCCP_BlitViewMode
+ * @brief Blends one view onto another with a blend mode, see CCCP_BlitSurfaceMode.
+ * @discussion The views may alias the same surface, even overlapping.
+ */
+void CCCP_BlitViewMode(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y, CCCP_BlendMode mode);
+
 /*!
  * @function CCCP_SurfaceFromPerlinNoise
  * @brief Creates a surface filled with Perlin noise.
@@ -730,6 +1316,35 @@ CCCP_Surface CCCP_SurfaceFromConcentricCircles(unsigned int width, unsigned int
  */
 CCCP_Shader CCCP_NewShader(CCCP_ShaderFunc func, int numThreads);
 
+/*!
+ * @function CCCP_NewTileShader
+ * @brief Creates a new shader that shades a whole tile per call.
+ * @param func The per-pixel shader function, kept for callers that want it.
+ * @param tile The tile shader function.
+ * @param numThreads Number of threads to use (0 = hardware concurrency).
+ * @return A new CCCP_Shader.
+ * @discussion Use CCCP_NewDefinedShader for shaders declared with CCCP_DEFINE_SHADER.
+ */
+CCCP_Shader CCCP_NewTileShader(CCCP_ShaderFunc func, CCCP_ShaderTileFunc tile, int numThreads);
+
+/*!
+ * @function CCCP_NewShader4
+ * @brief Creates a new shader that shades 4 pixels per call.
+ * @param func The packet shader function.
+ * @param numThreads Number of threads to use (0 = hardware concurrency).
+ * @return A new CCCP_Shader.
+ */
+CCCP_Shader CCCP_NewShader4(CCCP_ShaderFunc4 func, int numThreads);
+
+/*!
+ * @function CCCP_NewShader8
+ * @brief Creates a new shader that shades 8 pixels per call.
+ * @param func The packet shader function.
+ * @param numThreads Number of threads to use (0 = hardware concurrency).
+ * @return A new CCCP_Shader.
+ */
+CCCP_Shader CCCP_NewShader8(CCCP_ShaderFunc8 func, int numThreads);
+
 /*!
  * @function CCCP_DestroyShader
  * @brief Destroys a shader.
@@ -737,6 +1352,14 @@ CCCP_Shader CCCP_NewShader(CCCP_ShaderFunc func, int numThreads);
  */
 void CCCP_DestroyShader(CCCP_Shader *shader);
 
+/*!
+ * @function CCCP_SetShaderUniforms
+ * @brief Sets the per-frame uniforms that CCCP_ApplyShader hands to shaders.
+ * @param uniforms Pointer to the uniforms, kept up to date by the caller (NULL = zeroed).
+ * @discussion The runtime binds its own uniforms automatically, resolution is always overwritten with the target surface's size.
+ */
+void CCCP_SetShaderUniforms(const CCCP_ShaderUniforms *uniforms);
+
 /*!
  * @function CCCP_ApplyShader
  * @brief Applies a shader to a surface.
@@ -747,6 +1370,62 @@ void CCCP_DestroyShader(CCCP_Shader *shader);
  */
 bool CCCP_ApplyShader(CCCP_Surface surface, CCCP_Shader *shader, void* userdata);
 
+/*!
+ * @function CCCP_ApplyShaderAsync
+ * @brief Starts applying a shader to a surface and returns without waiting for it to finish.
+ * @param surface The surface to apply the shader to.
+ * @param shader Pointer to the shader.
+ * @param userdata User-defined data to pass to the shader function.
+ * @return A fence that is signaled once every tile is shaded, or 0 if the shader or surface is invalid.
+ * @discussion The surface and userdata must stay valid until the fence is done. The runtime waits on any outstanding fences before presenting the frame.
+ */
+CCCP_Fence CCCP_ApplyShaderAsync(CCCP_Surface surface, CCCP_Shader *shader, void* userdata);
+
+/*!
+ * @function CCCP_ApplyShaderView
+ * @brief Applies a shader to a view, e.g. one viewport of a split screen.
+ * @discussion Fragment coordinates and the resolution uniform are relative to the view.
+ * @param view The view to apply the shader to.
+ * @param shader Pointer to the shader.
+ * @param userdata User-defined data to pass to the shader function.
+ * @return true if the shader was applied successfully, false otherwise.
+ */
+bool CCCP_ApplyShaderView(CCCP_SurfaceView view, CCCP_Shader *shader, void* userdata);
+
+/*!
+ * @function CCCP_ApplyShaderViewAsync
+ * @brief Starts applying a shader to a view, see CCCP_ApplyShaderAsync.
+ * @param view The view to apply the shader to.
+ * @param shader Pointer to the shader.
+ * @param userdata User-defined data to pass to the shader function.
+ * @return A fence that is signaled once every tile is shaded, or 0 if the shader or view is invalid.
+ */
+CCCP_Fence CCCP_ApplyShaderViewAsync(CCCP_SurfaceView view, CCCP_Shader *shader, void* userdata);
+
+/*!
+ * @function CCCP_FenceDone
+ * @brief Checks whether an asynchronous shader pass has finished.
+ * @param fence The fence to check.
+ * @return true if the pass has finished (or the fence is 0/stale), false otherwise.
+ */
+bool CCCP_FenceDone(CCCP_Fence fence);
+
+/*!
+ * @function CCCP_WaitFence
+ * @brief Blocks until an asynchronous shader pass has finished.
+ * @param fence The fence to wait on.
+ * @discussion The calling thread helps run queued work while it waits. Must not be called from inside a thread pool job.
+ */
+void CCCP_WaitFence(CCCP_Fence fence);
+
+/*!
+ * @function CCCP_WaitAllFences
+ * @brief Blocks until every asynchronous shader pass started so far has finished.
+ * @discussion Only waits on shader passes, other work queued on the thread pool keeps running. The runtime calls
+ * this before presenting each frame. Same restrictions as CCCP_WaitFence().
+ */
+void CCCP_WaitAllFences(void);
+
 /*!
  * @function CCCP_DebugPrintASCII
  * @brief Prints ASCII text to a surface for debugging.
@@ -769,6 +1448,65 @@ void CCCP_DebugPrintASCII(CCCP_Surface surface, int x, int y, const char* text,
  */
 void CCCP_DebugPrintUnicode(CCCP_Surface surface, int x, int y, const wchar_t* text, color_t color);
 
+/*!
+ * @function CCCP_NewShaderGraph
+ * @brief Creates an empty shader graph.
+ * @param width Width of every pass output.
+ * @param height Height of every pass output.
+ * @return A new CCCP_ShaderGraph, or NULL on failure.
+ */
+CCCP_ShaderGraph* CCCP_NewShaderGraph(unsigned int width, unsigned int height);
+
+/*!
+ * @function CCCP_DestroyShaderGraph
+ * @brief Destroys a shader graph and the surfaces it owns.
+ * @param graph The shader graph to destroy.
+ */
+void CCCP_DestroyShaderGraph(CCCP_ShaderGraph *graph);
+
+/*!
+ * @function CCCP_AddShaderPass
+ * @brief Adds a pass to a shader graph.
+ * @param graph The shader graph.
+ * @param shader Pointer to the shader, copied into the graph.
+ * @param inputs Surfaces the pass reads from (can be NULL).
+ * @param input_count Number of inputs (at most CCCP_MAX_PASS_INPUTS).
+ * @param userdata User-defined data, available as CCCP_ShaderPass.userdata.
+ * @return The index of the new pass, or -1 on failure.
+ * @discussion Each pass owns two surfaces that are swapped every run, so reading the previous frame never copies.
+ */
+int CCCP_AddShaderPass(CCCP_ShaderGraph *graph, CCCP_Shader *shader, const CCCP_PassInput *inputs, int input_count, void *userdata);
+
+/*!
+ * @function CCCP_RunShaderGraph
+ * @brief Runs every pass of a shader graph once.
+ * @param graph The shader graph.
+ * @return true if every pass was applied successfully, false otherwise.
+ * @discussion Passes that don't depend on each other in the current frame are dispatched on the thread pool together.
+ */
+bool CCCP_RunShaderGraph(CCCP_ShaderGraph *graph);
+
+/*!
+ * @function CCCP_ShaderGraphOutput
+ * @brief Gets the output of a pass from the most recent run.
+ * @param graph The shader graph.
+ * @param pass Index of the pass.
+ * @return The pass's output surface, or NULL if the pass doesn't exist.
+ * @discussion The surface is owned by the graph and becomes the previous frame on the next run.
+ */
+CCCP_Surface CCCP_ShaderGraphOutput(CCCP_ShaderGraph *graph, int pass);
+
+/*!
+ * @function CCCP_ResizeShaderGraph
+ * @brief Changes the size of every pass output.
+ * @param graph The shader graph.
+ * @param width New width.
+ * @param height New height.
+ * @return true on success, false otherwise.
+ * @discussion Previous frame contents are lost.
+ */
+bool CCCP_ResizeShaderGraph(CCCP_ShaderGraph *graph, unsigned int width, unsigned int height);
+
 /* === AUDIO === */
 
 /*!
@@ -1172,6 +1910,469 @@ double CCCP_GetElapsedTime(CCCP_Timer* timer);
  */
 void CCCP_Sleep(double seconds);
 
+/*!
+ * @function CCCP_GetTime
+ * @brief Reads the monotonic clock timers are built on.
+ * @return Seconds since an arbitrary point, only meaningful relative to other calls.
+ */
+double CCCP_GetTime(void);
+
+/*!
+ * @function CCCP_SleepUntil
+ * @brief Sleeps until an absolute point on the CCCP_GetTime clock.
+ * @discussion Sleeps coarsely, then yields in a loop for the last stretch, scheduler wake-up latency would otherwise overshoot the deadline. Returns straight away if the deadline has passed.
+ * @param deadline The time to wake at.
+ */
+void CCCP_SleepUntil(double deadline);
+
+/* === FRAME PACING === */
+
+// Number of frames CCCP_GetFrameStats looks back over
+#define CCCP_FRAME_HISTORY 256
+
+/*!
+ * @typedef CCCP_FrameHistory
+ * @brief Opaque ring buffer of per-frame timings.
+ */
+typedef struct CCCP_FrameHistory CCCP_FrameHistory;
+
+/*!
+ * @struct CCCP_FrameStats
+ * @brief Frame pacing summary, over the last CCCP_FRAME_HISTORY frames when it comes from a history.
+ * @field frames Number of frames the summary covers.
+ * @field average Mean time between frames in seconds.
+ * @field p50 Median time between frames in seconds.
+ * @field p99 99th percentile time between frames in seconds.
+ * @field worst Longest time between frames in seconds.
+ * @field work Mean time spent on a frame before sleeping, in seconds.
+ * @field missed Frames within the history that overran their deadline.
+ * @field totalMissed Frames that overran their deadline since the history was created.
+ */
+typedef struct {
+    int frames;
+    double average, p50, p99, worst;
+    double work;
+    int missed;
+    uint64_t totalMissed;
+} CCCP_FrameStats;
+
+/*!
+ * @function CCCP_NewFrameHistory
+ * @brief Creates an empty frame history.
+ * @return A new CCCP_FrameHistory, or NULL on allocation failure.
+ */
+CCCP_FrameHistory* CCCP_NewFrameHistory(void);
+
+/*!
+ * @function CCCP_DestroyFrameHistory
+ * @brief Destroys a frame history.
+ * @param history The history to destroy.
+ */
+void CCCP_DestroyFrameHistory(CCCP_FrameHistory *history);
+
+/*!
+ * @function CCCP_RecordFrame
+ * @brief Adds a frame to the history, overwriting the oldest once full.
+ * @param history The history.
+ * @param frameTime Time since the previous frame started, in seconds.
+ * @param workTime Time spent on the frame before sleeping, in seconds.
+ * @param missed Whether the frame overran its deadline.
+ */
+void CCCP_RecordFrame(CCCP_FrameHistory *history, double frameTime, double workTime, bool missed);
+
+/*!
+ * @function CCCP_SetFrameHistory
+ * @brief Sets the history CCCP_GetFrameStats reads from.
+ * @discussion The runtime binds the history its frame pacer records into automatically.
+ * @param history The history to use.
+ */
+void CCCP_SetFrameHistory(CCCP_FrameHistory *history);
+
+/*!
+ * @function CCCP_GetFrameHistory
+ * @brief Gets the history CCCP_GetFrameStats reads from.
+ * @return The current history, or NULL if none has been set.
+ */
+CCCP_FrameHistory* CCCP_GetFrameHistory(void);
+
+/*!
+ * @function CCCP_GetFrameStats
+ * @brief Summarises the current frame history.
+ * @param stats Receives the summary.
+ * @return false if there is no history or nothing has been recorded yet.
+ */
+bool CCCP_GetFrameStats(CCCP_FrameStats *stats);
+
+/*!
+ * @function CCCP_SummariseFrameTimes
+ * @brief Summarises a list of frame times that don't fit in a history, e.g. a whole headless run.
+ * @discussion Nothing sleeps or misses a deadline here, so work matches average and the missed counts are 0.
+ * @param times The time each frame took in seconds, sorted in place.
+ * @param count Number of times.
+ * @param stats Receives the summary.
+ * @return false if there are no times.
+ */
+bool CCCP_SummariseFrameTimes(double *times, int count, CCCP_FrameStats *stats);
+
+/* === FRAME SINKS === */
+
+/*!
+ * @struct CCCP_RunStats
+ * @brief Throughput of a headless run, handed to the frame sink when it closes.
+ * @field frames Number of frames rendered.
+ * @field wallTime Seconds the run took.
+ * @field sceneTime Seconds of scene time simulated.
+ * @field timing Time spent on each frame, over every frame of the run.
+ */
+typedef struct {
+    uint64_t frames;
+    double wallTime, sceneTime;
+    CCCP_FrameStats timing;
+} CCCP_RunStats;
+
+typedef struct CCCP_FrameSink CCCP_FrameSink;
+
+/*!
+ * @struct CCCP_FrameSink
+ * @brief Destination for frames rendered without a window.
+ * @field write Called with every finished frame, returning false ends the run.
+ * @field close Called once at the end of the run, frees the sink.
+ * @field userdata Sink specific state.
+ */
+struct CCCP_FrameSink {
+    bool(*write)(CCCP_FrameSink *sink, CCCP_Surface frame, uint64_t index);
+    void(*close)(CCCP_FrameSink *sink, const CCCP_RunStats *stats);
+    void *userdata;
+};
+
+/*!
+ * @typedef CCCP_FrameSinkOpener
+ * @brief Creates a sink for frames of the given size.
+ * @discussion target is whatever followed the colon in the sink spec, NULL if there was none.
+ */
+typedef CCCP_FrameSink*(*CCCP_FrameSinkOpener)(const char *target, unsigned int width, unsigned int height, double fps);
+
+/*!
+ * @function CCCP_RegisterFrameSink
+ * @brief Adds a sink that CCCP_OpenFrameSink can open by name.
+ * @param name Name used in sink specs, must outlive the registration.
+ * @param open Function that creates the sink.
+ * @return false if the name is taken or there's no room left.
+ */
+bool CCCP_RegisterFrameSink(const char *name, CCCP_FrameSinkOpener open);
+
+/*!
+ * @function CCCP_OpenFrameSink
+ * @brief Opens a sink from a "name" or "name:target" spec.
+ * @discussion "null" is always available, it throws frames away and prints the run's throughput when closed.
+ * "qoi:path", "png:path" and "gif:path" record the run, see CCCP_StartRecording.
+ * "rgba[:path]" and "y4m[:path]" stream raw RGBA or YUV 4:2:0 frames to a file or pipe, stdout if the
+ * path is missing or "-". The run's summary then goes to stderr so the stream can be piped straight into
+ * an encoder, e.g. `cccp scene.dylib -H -n 600 -o y4m | ffmpeg -i - out.mp4`.
+ * @param spec The sink spec.
+ * @param width Width of the frames that will be written.
+ * @param height Height of the frames that will be written.
+ * @param fps Frames per second of scene time.
+ * @return A new sink, or NULL if the name is unknown or the sink failed to open.
+ */
+CCCP_FrameSink* CCCP_OpenFrameSink(const char *spec, unsigned int width, unsigned int height, double fps);
+
+/*!
+ * @function CCCP_CloseFrameSink
+ * @brief Finishes a run and frees the sink.
+ * @param sink The sink.
+ * @param stats Throughput of the run.
+ */
+void CCCP_CloseFrameSink(CCCP_FrameSink *sink, const CCCP_RunStats *stats);
+
+/* === RECORDING === */
+
+/*!
+ * @enum CCCP_RecordFormat
+ * @brief What a recording is written as.
+ * @constant RECORD_QOI A numbered sequence of QOI images.
+ * @constant RECORD_PNG A numbered sequence of PNG images.
+ * @constant RECORD_GIF A single looping animated GIF, each frame gets its own 256 colour palette.
+ */
+typedef enum {
+    RECORD_QOI,
+    RECORD_PNG,
+    RECORD_GIF
+} CCCP_RecordFormat;
+
+/*!
+ * @enum CCCP_RecordBackpressure
+ * @brief What happens to a frame when every buffered frame is still waiting to be encoded.
+ * @constant RECORD_DROP The frame is skipped, rendering never waits on the encoders.
+ * @constant RECORD_BLOCK Rendering waits for a free buffer, no frame is lost.
+ */
+typedef enum {
+    RECORD_DROP,
+    RECORD_BLOCK
+} CCCP_RecordBackpressure;
+
+/*!
+ * @typedef CCCP_Recorder
+ * @brief Opaque frame recorder, a bounded ring of frames drained by encoder threads.
+ */
+typedef struct CCCP_Recorder CCCP_Recorder;
+
+/*!
+ * @function CCCP_NewRecorder
+ * @brief Creates an idle recorder.
+ * @return A new CCCP_Recorder, or NULL on failure.
+ */
+CCCP_Recorder* CCCP_NewRecorder(void);
+
+/*!
+ * @function CCCP_DestroyRecorder
+ * @brief Stops any recording in progress and destroys the recorder.
+ * @param recorder The recorder to destroy.
+ */
+void CCCP_DestroyRecorder(CCCP_Recorder *recorder);
+
+/*!
+ * @function CCCP_SetRecorder
+ * @brief Sets the recorder the functions below act on.
+ * @discussion The runtime binds its own recorder automatically and captures every frame it produces while recording.
+ * @param recorder The recorder to use.
+ */
+void CCCP_SetRecorder(CCCP_Recorder *recorder);
+
+/*!
+ * @function CCCP_GetRecorder
+ * @brief Gets the recorder the functions below act on.
+ * @return The current recorder, or NULL if none has been set.
+ */
+CCCP_Recorder* CCCP_GetRecorder(void);
+
+/*!
+ * @function CCCP_StartRecording
+ * @brief Starts recording frames, stopping any recording in progress first.
+ * @discussion For image sequences path is either a printf pattern taking the frame number as an int ("shots/%05d.png") or a prefix the number and extension are appended to. For GIFs it's the file name.
+ * @param path Where to write to.
+ * @param format What to write.
+ * @return false if there's no recorder or the output couldn't be opened.
+ */
+bool CCCP_StartRecording(const char *path, CCCP_RecordFormat format);
+
+/*!
+ * @function CCCP_StopRecording
+ * @brief Stops recording, waiting for every buffered frame to be written.
+ */
+void CCCP_StopRecording(void);
+
+/*!
+ * @function CCCP_IsRecording
+ * @brief Checks if a recording is in progress.
+ * @return true while recording.
+ */
+bool CCCP_IsRecording(void);
+
+/*!
+ * @function CCCP_SetRecordingBackpressure
+ * @brief Sets what happens when the encoders fall behind, RECORD_DROP by default.
+ * @param mode The backpressure mode.
+ */
+void CCCP_SetRecordingBackpressure(CCCP_RecordBackpressure mode);
+
+/*!
+ * @function CCCP_CaptureFrame
+ * @brief Hands a finished frame to the recording.
+ * @discussion Costs the calling thread one copy of the frame. Called by the runtime, scenes don't need to.
+ * @param frame The frame.
+ * @param time Scene time of the frame in seconds, used for GIF frame delays.
+ * @return false if nothing is being recorded or the frame was dropped.
+ */
+bool CCCP_CaptureFrame(CCCP_Surface frame, double time);
+
+/*!
+ * @function CCCP_GetRecordingStats
+ * @brief Counts the frames of the current or last recording.
+ * @param written Receives the number of frames written, may be NULL.
+ * @param dropped Receives the number of frames dropped, may be NULL.
+ * @return false if an encoder failed to write a frame.
+ */
+bool CCCP_GetRecordingStats(uint64_t *written, uint64_t *dropped);
+
+/* === FRAME ARENA === */
+
+/*!
+ * @typedef CCCP_FrameArena
+ * @brief Opaque store of recycled surface memory, bucketed by size and released in bulk once a frame has been presented.
+ */
+typedef struct CCCP_FrameArena CCCP_FrameArena;
+
+/*!
+ * @function CCCP_NewFrameArena
+ * @brief Creates an empty frame arena.
+ * @return A new CCCP_FrameArena, or NULL on failure.
+ */
+CCCP_FrameArena* CCCP_NewFrameArena(void);
+
+/*!
+ * @function CCCP_DestroyFrameArena
+ * @brief Destroys a frame arena and frees all of its memory, every surface it handed out included.
+ * @param arena The arena to destroy.
+ */
+void CCCP_DestroyFrameArena(CCCP_FrameArena *arena);
+
+/*!
+ * @function CCCP_SetFrameArena
+ * @brief Sets the arena the functions below act on.
+ * @discussion The runtime binds its own arena automatically and resets it after every frame it presents.
+ * @param arena The arena to use.
+ */
+void CCCP_SetFrameArena(CCCP_FrameArena *arena);
+
+/*!
+ * @function CCCP_GetFrameArena
+ * @brief Gets the arena the functions below act on.
+ * @return The current arena, or NULL if none has been set.
+ */
+CCCP_FrameArena* CCCP_GetFrameArena(void);
+
+/*!
+ * @function CCCP_BeginFrameArena
+ * @brief Makes the surfaces the transforms and generators return temporary.
+ * @discussion Until the matching CCCP_EndFrameArena() CCCP_ResizeSurface, CCCP_RotateSurface, CCCP_FlipSurface,
+ * CCCP_ClipSurface and the CCCP_SurfaceFrom* functions take their memory from the arena. CCCP_NewSurface and
+ * CCCP_CopySurface always make lasting surfaces, and so does everything cached internally, like font glyphs and
+ * shader graph outputs. Calls can be nested. Temporary surfaces are only valid until the end of the frame.
+ * Destroying one does nothing. Only call this from the thread that ticks the scene.
+ * @return false if there's no arena, surfaces are allocated as usual. Still call CCCP_EndFrameArena().
+ */
+bool CCCP_BeginFrameArena(void);
+
+/*!
+ * @function CCCP_EndFrameArena
+ * @brief Goes back to allocating surfaces normally after CCCP_BeginFrameArena().
+ */
+void CCCP_EndFrameArena(void);
+
+/*!
+ * @function CCCP_EnterFrameArena
+ * @brief Sends the surfaces the calling thread makes to the arena, if between CCCP_BeginFrameArena() and CCCP_EndFrameArena().
+ * @discussion Used by the functions that hand new surfaces back to the scene, scenes don't need to.
+ * @return true if the arena is in use, CCCP_LeaveFrameArena() must then be called once the surface is made.
+ */
+bool CCCP_EnterFrameArena(void);
+
+/*!
+ * @function CCCP_LeaveFrameArena
+ * @brief Goes back to allocating surfaces normally after CCCP_EnterFrameArena().
+ */
+void CCCP_LeaveFrameArena(void);
+
+/*!
+ * @function CCCP_TempSurface
+ * @brief Creates a surface that only lasts until the end of the frame.
+ * @param w Width of the surface.
+ * @param h Height of the surface.
+ * @param clearColor Initial clear color for the surface.
+ * @return The surface, or NULL if there's no arena or it's too big to recycle.
+ */
+CCCP_Surface CCCP_TempSurface(unsigned int w, unsigned int h, color_t clearColor);
+
+/*!
+ * @function CCCP_ResetFrameArena
+ * @brief Takes back every surface the arena handed out, ready for the next frame.
+ * @discussion Memory the scene hasn't asked for in a while is given back to the system. Called by the runtime once
+ * a frame has been presented, scenes don't need to.
+ * @param arena The arena to reset.
+ */
+void CCCP_ResetFrameArena(CCCP_FrameArena *arena);
+
+/*!
+ * @function CCCP_GetFrameArenaStats
+ * @brief Measures the current arena.
+ * @param inUse Receives the bytes handed out this frame, may be NULL.
+ * @param retained Receives the bytes the arena is holding on to, may be NULL.
+ * @return false if there's no arena.
+ */
+bool CCCP_GetFrameArenaStats(size_t *inUse, size_t *retained);
+
+/* === THREAD POOL === */
+
+/*!
+ * @typedef CCCP_ThreadPool
+ * @brief Opaque type representing a pool of worker threads.
+ */
+typedef struct CCCP_ThreadPool CCCP_ThreadPool;
+
+/*!
+ * @function CCCP_NewThreadPool
+ * @brief Creates a new thread pool.
+ * @param numThreads Number of worker threads (0 = hardware concurrency).
+ * @return A new CCCP_ThreadPool, or NULL on failure.
+ */
+CCCP_ThreadPool* CCCP_NewThreadPool(int numThreads);
+
+/*!
+ * @function CCCP_DestroyThreadPool
+ * @brief Waits for outstanding jobs and destroys a thread pool.
+ * @param pool The thread pool to destroy.
+ */
+void CCCP_DestroyThreadPool(CCCP_ThreadPool *pool);
+
+/*!
+ * @function CCCP_ThreadPoolSize
+ * @brief Gets the number of worker threads in a pool.
+ * @param pool The thread pool.
+ * @return The number of worker threads.
+ */
+int CCCP_ThreadPoolSize(CCCP_ThreadPool *pool);
+
+/*!
+ * @function CCCP_ThreadPoolSubmit
+ * @brief Submits a job to a thread pool.
+ * @param pool The thread pool.
+ * @param func The function to run.
+ * @param arg Argument passed to the function.
+ * @return true if the job was queued, false otherwise.
+ */
+bool CCCP_ThreadPoolSubmit(CCCP_ThreadPool *pool, void(*func)(void*), void *arg);
+
+/*!
+ * @function CCCP_ThreadPoolWait
+ * @brief Blocks until every job submitted to a pool has finished.
+ * @param pool The thread pool.
+ */
+void CCCP_ThreadPoolWait(CCCP_ThreadPool *pool);
+
+/*!
+ * @function CCCP_ThreadPoolHelp
+ * @brief Runs one queued job on the calling thread.
+ * @param pool The thread pool, may be NULL.
+ * @return true if a job was run, false if nothing was queued.
+ */
+bool CCCP_ThreadPoolHelp(CCCP_ThreadPool *pool);
+
+/*!
+ * @function CCCP_ThreadPoolWaitFor
+ * @brief Blocks until a counter of outstanding jobs drops to zero.
+ * @discussion Unlike CCCP_ThreadPoolWait this only waits on the caller's own jobs, which decrement the counter as
+ * they finish. The calling thread runs queued jobs, anyone's, while it waits.
+ * @param pool The thread pool, may be NULL.
+ * @param counter The counter to wait on.
+ */
+void CCCP_ThreadPoolWaitFor(CCCP_ThreadPool *pool, atomic_int *counter);
+
+/*!
+ * @function CCCP_SetThreadPool
+ * @brief Sets the pool used by shaders and other parallel helpers.
+ * @param pool The thread pool (NULL to unset).
+ * @discussion The runtime creates one pool at startup and hands it to each scene library when it is loaded.
+ */
+void CCCP_SetThreadPool(CCCP_ThreadPool *pool);
+
+/*!
+ * @function CCCP_GetThreadPool
+ * @brief Gets the pool used by shaders and other parallel helpers.
+ * @return The current thread pool, or NULL if none has been set.
+ */
+CCCP_ThreadPool* CCCP_GetThreadPool(void);
+
 /* === HASH TABLE === */
 
 /*!
@@ -36,6 +36,15 @@
 #ifndef TARGET_FPS
 #define TARGET_FPS 60
 #endif
+#ifndef DYNAMIC_RESOLUTION_STEPS
+#define DYNAMIC_RESOLUTION_STEPS 5
+#endif
+#define FRAMEBUFFER_COUNT 3
+#define FRAME_FRESH 4 // Set on the ready slot until the present thread picks it up
+#define IDLE_RELOAD_CHECK .25 // Idle scenes still notice rebuilt libraries
+
+// Framebuffer scales used by dynamic resolution, largest first
+static const float resolution_scales[DYNAMIC_RESOLUTION_STEPS] = { 1.f, .85f, .7f, .6f, .5f };
 
 #if defined(PLATFORM_WINDOWS)
 #include <Windows.h>
@@ -74,12 +83,61 @@ static struct {
     CCCP_Surface buffer;
     CCCP_AudioContext* audio;
     CCCP_Timer* frame_timer;
+    CCCP_ThreadPool* pool;
+    CCCP_Recorder* recorder;
+    CCCP_FrameArena* arena;
+    void(*waitFences)(void); // The scene's own CCCP_WaitAllFences
+    CCCP_ShaderUniforms uniforms;
+    double time;
+    bool idle; // The scene returned TICK_IDLE, cleared by any event
+    double idleSince;
+    struct {
+        int step;
+        double average; // Smoothed time spent on a frame, excluding sleep
+        int over, under; // Consecutive frames spent over/under budget
+        CCCP_Surface surfaces[DYNAMIC_RESOLUTION_STEPS][FRAMEBUFFER_COUNT]; // Reused between steps
+        uint64_t drawn[DYNAMIC_RESOLUTION_STEPS][FRAMEBUFFER_COUNT]; // Frame + 1 each surface was last drawn in
+    } dynamic;
+    // Triple buffered handoff to the present thread, the main thread renders
+    // into `render`, the present thread shows `present` and the last finished
+    // frame waits in `ready`. Slots only ever change hands by atomic exchange
+    struct {
+        thrd_t thread;
+        int threaded;
+        atomic_bool running;
+        atomic_int ready;
+        int render, present;
+        CCCP_Surface frames[FRAMEBUFFER_COUNT];
+        CCCP_Surface previous; // Last finished frame, partial redraws build on it
+        mtx_t mutex; // Only used to sleep the present thread
+        cnd_t wake;
+    } present;
+    struct {
+        CCCP_Timer *timer;
+        int frames;
+        atomic_int dropped;
+        double render;
+        atomic_llong present; // Microseconds, written by the present thread
+    } stats;
+    struct {
+        CCCP_FrameHistory *history;
+        double deadline, interval; // Absolute, on the CCCP_GetTime clock
+    } pacing;
     struct {
         unsigned int width;
         unsigned int height;
         const char *title;
         CCCP_WindowFlags flags;
         char *path;
+        int dynamic;
+        int stats;
+        int headless;
+        int mute;
+        long long frames;
+        double seconds;
+        const char *sink;
+        const char *record;
+        int recordBlock;
     } args;
 } state;
 
@@ -91,6 +149,15 @@ static struct option long_options[] = {
     {"top", no_argument, NULL, 'a'},
     {"usage", no_argument, NULL, 'u'},
     {"path", required_argument, NULL, 'p'},
+    {"dynamic", no_argument, NULL, 'd'},
+    {"stats", no_argument, NULL, 's'},
+    {"headless", no_argument, NULL, 'H'},
+    {"frames", required_argument, NULL, 'n'},
+    {"seconds", required_argument, NULL, 'S'},
+    {"sink", required_argument, NULL, 'o'},
+    {"mute", no_argument, NULL, 'm'},
+    {"record", required_argument, NULL, 'R'},
+    {"record-block", no_argument, NULL, 'b'},
     {NULL, 0, NULL, 0}
 };
 
@@ -108,6 +175,16 @@ static void usage(void) {
     puts("      -t/--title     Window title [default: \"fwp\"]");
     puts("      -r/--resizable Enable resizable window");
     puts("      -a/--top       Enable window always on top");
+    puts("      -d/--dynamic   Scale the framebuffer to hold the target FPS");
+    puts("      -s/--stats     Print render and present times every second");
+    puts("      -H/--headless  Render without a window, as fast as possible");
+    puts("      -n/--frames    Stop a headless run after this many frames");
+    puts("      -S/--seconds   Stop a headless run after this much scene time");
+    puts("      -o/--sink      Where headless frames go, name[:target] [default: null]");
+    puts("                     null, qoi|png|gif:path, or rgba|y4m[:path] to stream raw frames (stdout by default)");
+    puts("      -m/--mute      Don't open an audio device");
+    puts("      -R/--record    Record frames to a .gif, or an image sequence prefix/pattern");
+    puts("      -b/--record-block Stall rendering instead of dropping frames while recording");
     puts("      -u/--usage     Display this message");
 }
 
@@ -123,6 +200,16 @@ static FILETIME Win32GetLastWriteTime(char* path) {
 }
 #endif
 
+static int LibraryChanged(void) {
+#ifdef _WIN32
+    FILETIME newTime = Win32GetLastWriteTime(state.args.path);
+    return CompareFileTime(&newTime, &state.writeTime);
+#else
+    struct stat attr;
+    return !stat(state.args.path, &attr) && state.handleID != attr.st_ino;
+#endif
+}
+
 static int ShouldReloadLibrary(void) {
 #ifdef _WIN32
     FILETIME newTime = Win32GetLastWriteTime(state.args.path);
@@ -178,18 +265,42 @@ static int ReloadLibrary(const char *path) {
         goto BAIL;
     if (!(state.scene = dlsym(state.handle, "scene")))
         goto BAIL;
+    // Scene libraries carry their own copy of cccp, share the runtime's pool
+    void(*setThreadPool)(CCCP_ThreadPool*) = dlsym(state.handle, "CCCP_SetThreadPool");
+    if (setThreadPool)
+        setThreadPool(state.pool);
+    void(*setShaderUniforms)(const CCCP_ShaderUniforms*) = dlsym(state.handle, "CCCP_SetShaderUniforms");
+    if (setShaderUniforms)
+        setShaderUniforms(&state.uniforms);
+    void(*setFrameHistory)(CCCP_FrameHistory*) = dlsym(state.handle, "CCCP_SetFrameHistory");
+    if (setFrameHistory)
+        setFrameHistory(state.pacing.history);
+    void(*setRecorder)(CCCP_Recorder*) = dlsym(state.handle, "CCCP_SetRecorder");
+    if (setRecorder)
+        setRecorder(state.recorder);
+    void(*setFrameArena)(CCCP_FrameArena*) = dlsym(state.handle, "CCCP_SetFrameArena");
+    if (setFrameArena)
+        setFrameArena(state.arena);
+    // Fences live in the module that started the pass, the scene's passes
+    // have to be waited on through its own copy
+    if (!(state.waitFences = dlsym(state.handle, "CCCP_WaitAllFences")))
+        state.waitFences = CCCP_WaitAllFences;
     if (!state.state) {
-        if (state.scene->windowWidth > 0 && state.scene->windowHeight > 0)
-            WindowSetSize(state.scene->windowWidth, state.scene->windowHeight);
-        if (state.scene->windowTitle)
-            WindowSetTitle(state.scene->windowTitle);
+        if (!state.args.headless) {
+            if (state.scene->windowWidth > 0 && state.scene->windowHeight > 0)
+                WindowSetSize(state.scene->windowWidth, state.scene->windowHeight);
+            if (state.scene->windowTitle)
+                WindowSetTitle(state.scene->windowTitle);
+        }
         if (!(state.state = state.scene->init(state.buffer, state.audio)))
             goto BAIL;
     } else {
-        if (state.scene->windowWidth > 0 && state.scene->windowHeight > 0)
-            WindowSetSize(state.scene->windowWidth, state.scene->windowHeight);
-        if (state.scene->windowTitle)
-            WindowSetTitle(state.scene->windowTitle);
+        if (!state.args.headless) {
+            if (state.scene->windowWidth > 0 && state.scene->windowHeight > 0)
+                WindowSetSize(state.scene->windowWidth, state.scene->windowHeight);
+            if (state.scene->windowTitle)
+                WindowSetTitle(state.scene->windowTitle);
+        }
         if (state.scene->reload)
             state.scene->reload(state.state, state.audio);
     }
@@ -207,9 +318,13 @@ BAIL:
     return 0;
 }
 
-#define CCCP_Callback(E)    \
-    if (state.scene->event) \
-        state.scene->event(state.state, &(E), state.audio)
+// Any event wakes an idle scene
+#define CCCP_Callback(E)                                        \
+    do {                                                        \
+        state.idle = false;                                     \
+        if (state.scene->event)                                 \
+            state.scene->event(state.state, &(E), state.audio); \
+    } while (0)
 
 static void CCCP_Keyboard(void *userdata, int key, int modifier, int isDown) {
     CCCP_Event e = {
@@ -236,6 +351,7 @@ static void CCCP_MouseButton(void *userdata, int button, int modifier, int isDow
 }
 
 static void CCCP_MouseMove(void *userdata, int x, int y, float dx, float dy) {
+    state.uniforms.mouse = (vec2){ (float)x, (float)y };
     CCCP_Event e = {
         .type = MouseMoveEvent,
         .mouse = {
@@ -286,12 +402,411 @@ static void CCCP_Resized(void *userdata, int w, int h) {
     CCCP_Callback(e);
 }
 
+static void FramebufferSize(int step, unsigned int *w, unsigned int *h) {
+    *w = (unsigned int)(state.args.width * resolution_scales[step]);
+    *h = (unsigned int)(state.args.height * resolution_scales[step]);
+    if (!*w)
+        *w = 1;
+    if (!*h)
+        *h = 1;
+}
+
+static CCCP_Surface AcquireFramebuffer(void) {
+    CCCP_Surface *surface = &state.dynamic.surfaces[state.dynamic.step][state.present.render];
+    if (!*surface) {
+        unsigned int w, h;
+        FramebufferSize(state.dynamic.step, &w, &h);
+        if ((*surface = state.args.headless ? CCCP_NewSurface(w, h, rgb(0, 0, 0)) : WindowNewFramebuffer(w, h)))
+            CCCP_TrackDirtyRegions(*surface, true);
+    }
+    return *surface;
+}
+
+static void CopyRegion(CCCP_Surface dest, CCCP_Surface src, CCCP_Rect r) {
+    int w = CCCP_SurfaceWidth(dest);
+    for (int y = r.y; y < r.y + r.h; y++)
+        memcpy(dest + y * w + r.x, src + y * w + r.x, r.w * sizeof(color_t));
+}
+
+// Gets the framebuffer ready for the scene to draw into. Partial redraws
+// need the last frame's contents, the slot is brought up to date by copying
+// whatever the other slots changed since it was last drawn in
+static void PrepareFramebuffer(CCCP_Surface buffer) {
+    uint64_t *drawn = &state.dynamic.drawn[state.dynamic.step][state.present.render];
+    uint64_t frame = state.uniforms.frame + 1;
+    CCCP_Surface previous = state.present.previous;
+    int w = CCCP_SurfaceWidth(buffer), h = CCCP_SurfaceHeight(buffer);
+    CCCP_ClearDirty(buffer);
+    switch (state.scene->redraw) {
+        case REDRAW_FULL:
+            break;
+        case REDRAW_PARTIAL:
+            if (!previous || previous == buffer)
+                break;
+            // Nothing to build on after a resolution change, the scene was sent a FramebufferResizedEvent
+            if (CCCP_SurfaceWidth(previous) != w || CCCP_SurfaceHeight(previous) != h) {
+                CCCP_ClearSurface(buffer, state.scene->clearColor);
+                break;
+            }
+            if (!*drawn || frame - *drawn > FRAMEBUFFER_COUNT) {
+                CopyRegion(buffer, previous, (CCCP_Rect){0, 0, w, h});
+                break;
+            }
+            for (int i = 0; i < FRAMEBUFFER_COUNT; i++) {
+                CCCP_Surface other = state.dynamic.surfaces[state.dynamic.step][i];
+                if (!other || other == buffer)
+                    continue;
+                CCCP_Rect rects[CCCP_MAX_DIRTY_RECTS];
+                int count = CCCP_GetDirtyRects(other, rects, CCCP_MAX_DIRTY_RECTS);
+                if (count < 0) {
+                    count = 1;
+                    rects[0] = (CCCP_Rect){0, 0, w, h};
+                }
+                for (int j = 0; j < count; j++)
+                    CopyRegion(buffer, previous, rects[j]);
+            }
+            break;
+        case REDRAW_CLEAR:
+        default:
+            CCCP_ClearSurface(buffer, state.scene->clearColor);
+            break;
+    }
+    *drawn = frame;
+}
+
+static void UpdateDynamicResolution(double frame_time, double budget) {
+    state.dynamic.average = state.dynamic.average > 0 ? state.dynamic.average * .9 + frame_time * .1 : frame_time;
+    int step = state.dynamic.step;
+    // Drop quickly when over budget, only climb back after a sustained margin
+    if (state.dynamic.average > budget * .95) {
+        state.dynamic.under = 0;
+        if (++state.dynamic.over >= 8 && step < DYNAMIC_RESOLUTION_STEPS - 1)
+            step++;
+    } else if (state.dynamic.average < budget * .6) {
+        state.dynamic.over = 0;
+        if (++state.dynamic.under >= 60 && step > 0)
+            step--;
+    } else
+        state.dynamic.over = state.dynamic.under = 0;
+    if (step == state.dynamic.step)
+        return;
+
+    state.dynamic.step = step;
+    state.dynamic.average = 0;
+    state.dynamic.over = state.dynamic.under = 0;
+
+    unsigned int w, h;
+    FramebufferSize(step, &w, &h);
+    CCCP_Event e = {
+        .type = FramebufferResizedEvent,
+        .framebuffer = {
+            .width = w,
+            .height = h,
+            .scale = resolution_scales[step]
+        }
+    };
+    CCCP_Callback(e);
+}
+
+static int PresentThread(void *arg) {
+    CCCP_Timer *timer = CCCP_NewTimer();
+    while (atomic_load(&state.present.running)) {
+        mtx_lock(&state.present.mutex);
+        while (atomic_load(&state.present.running) && !(atomic_load(&state.present.ready) & FRAME_FRESH))
+            cnd_wait(&state.present.wake, &state.present.mutex);
+        mtx_unlock(&state.present.mutex);
+        if (!atomic_load(&state.present.running))
+            break;
+        // The slot being handed back must be finished with before the
+        // main thread can draw into it again
+        WindowWaitFlush();
+        state.present.present = atomic_exchange(&state.present.ready, state.present.present) & ~FRAME_FRESH;
+        CCCP_StartTimer(timer);
+        WindowFlush(state.present.frames[state.present.present]);
+        atomic_fetch_add(&state.stats.present, (long long)(CCCP_GetElapsedTime(timer) * 1000000.0));
+    }
+    WindowWaitFlush();
+    CCCP_DestroyTimer(timer);
+    return 0;
+}
+
+static int StartPresentThread(void) {
+    state.present.render = 0;
+    atomic_store(&state.present.ready, 1);
+    state.present.present = 2;
+    // Not every window system can present off the main thread
+    if (!WindowCanFlushFromThread())
+        return 1;
+    if (mtx_init(&state.present.mutex, mtx_plain) != thrd_success)
+        return 0;
+    if (cnd_init(&state.present.wake) != thrd_success) {
+        mtx_destroy(&state.present.mutex);
+        return 0;
+    }
+    atomic_store(&state.present.running, true);
+    if (thrd_create(&state.present.thread, PresentThread, NULL) != thrd_success) {
+        cnd_destroy(&state.present.wake);
+        mtx_destroy(&state.present.mutex);
+        return 0;
+    }
+    state.present.threaded = 1;
+    return 1;
+}
+
+static void StopPresentThread(void) {
+    if (!state.present.threaded)
+        return;
+    mtx_lock(&state.present.mutex);
+    atomic_store(&state.present.running, false);
+    cnd_signal(&state.present.wake);
+    mtx_unlock(&state.present.mutex);
+    thrd_join(state.present.thread, NULL);
+    cnd_destroy(&state.present.wake);
+    mtx_destroy(&state.present.mutex);
+    state.present.threaded = 0;
+}
+
+static void PresentFrame(CCCP_Surface buffer) {
+    // Copied out before the present thread can get its hands on it
+    CCCP_CaptureFrame(buffer, state.time);
+    // Only partial redraws are trusted to have marked everything they touched
+    if (state.scene->redraw != REDRAW_PARTIAL)
+        CCCP_MarkSurfaceDirty(buffer);
+    state.present.previous = buffer;
+    if (!state.present.threaded) {
+        CCCP_Timer *timer = state.stats.timer;
+        double start = CCCP_GetElapsedTime(timer);
+        WindowFlush(buffer);
+        atomic_fetch_add(&state.stats.present, (long long)((CCCP_GetElapsedTime(timer) - start) * 1000000.0));
+        return;
+    }
+    state.present.frames[state.present.render] = buffer;
+    // A frame that never made it to the screen gets overwritten, its changes
+    // go out with this one. Merged before the swap, the present thread may
+    // take the slot at any point after it. A lost race only adds extra tiles
+    int previous = atomic_load(&state.present.ready);
+    do {
+        if (previous & FRAME_FRESH)
+            CCCP_MergeDirty(buffer, state.present.frames[previous & ~FRAME_FRESH]);
+    } while (!atomic_compare_exchange_weak(&state.present.ready, &previous, state.present.render | FRAME_FRESH));
+    if (previous & FRAME_FRESH)
+        atomic_fetch_add(&state.stats.dropped, 1);
+    state.present.render = previous & ~FRAME_FRESH;
+    mtx_lock(&state.present.mutex);
+    cnd_signal(&state.present.wake);
+    mtx_unlock(&state.present.mutex);
+}
+
+static bool UpdateMusic(void) {
+    bool playing = false;
+    if (!state.audio)
+        return false;
+    // TODO: Loop through music streams and update them
+    CCCP_HashEntry* entry = state.audio->music->buckets;
+    while (entry) {
+        Music *music = (Music*)entry->value;
+        if (music && IsMusicStreamPlaying(*music)) {
+            UpdateMusicStream(*music);
+            playing = true;
+        }
+        entry = entry->next;
+    }
+    return playing;
+}
+
+// Blocks until an idle scene needs to tick again, returns 0 if the window closed
+static int WaitWhileIdle(void) {
+    while (state.idle) {
+        double wait = IDLE_RELOAD_CHECK;
+        if (state.scene->idleTimeout > 0) {
+            double left = state.idleSince + state.scene->idleTimeout - CCCP_GetTime();
+            if (left <= 0)
+                break;
+            if (left < wait)
+                wait = left;
+        }
+        // Streams run dry unless they're topped up every frame or so
+        double frame = 1.0 / (state.scene->targetFPS > 0 ? state.scene->targetFPS : TARGET_FPS);
+        if (UpdateMusic() && wait > frame)
+            wait = frame;
+        if (!WindowPollWait(wait))
+            return 0;
+        // Nothing new gets presented while idle, put the last frame back if the window lost it
+        if (WindowExposed() && state.present.previous)
+            WindowFlush(state.present.previous);
+        if (LibraryChanged())
+            break;
+    }
+    state.idle = false;
+    return 1;
+}
+
+static void UpdateStats(double render) {
+    state.stats.frames++;
+    state.stats.render += render;
+    double elapsed = CCCP_GetElapsedTime(state.stats.timer);
+    if (elapsed < 1.0)
+        return;
+    CCCP_FrameStats pacing = {0};
+    CCCP_GetFrameStats(&pacing);
+    if (state.args.stats)
+        printf("fps: %.1f, render: %.2fms, present: %.2fms, dropped: %d, p99: %.2fms, missed: %d\n",
+               state.stats.frames / elapsed,
+               state.stats.render / state.stats.frames * 1000.0,
+               atomic_exchange(&state.stats.present, 0) / 1000.0 / state.stats.frames,
+               atomic_exchange(&state.stats.dropped, 0),
+               pacing.p99 * 1000.0,
+               pacing.missed);
+    else {
+        atomic_store(&state.stats.present, 0);
+        atomic_store(&state.stats.dropped, 0);
+    }
+    state.stats.frames = 0;
+    state.stats.render = 0;
+    CCCP_StartTimer(state.stats.timer);
+}
+
+static CCCP_RecordFormat RecordFormatFromPath(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if (extension && !strcmp(extension, ".gif"))
+        return RECORD_GIF;
+    if (extension && !strcmp(extension, ".png"))
+        return RECORD_PNG;
+    return RECORD_QOI;
+}
+
+// The recorder always exists so scenes can start recording themselves
+static bool StartRecorder(void) {
+    if (!(state.recorder = CCCP_NewRecorder()))
+        return false;
+    CCCP_SetRecorder(state.recorder);
+    if (!state.args.record)
+        return true;
+    CCCP_SetRecordingBackpressure(state.args.recordBlock ? RECORD_BLOCK : RECORD_DROP);
+    if (!CCCP_StartRecording(state.args.record, RecordFormatFromPath(state.args.record))) {
+        fprintf(stderr, "ERROR: Failed to start recording to \"%s\"\n", state.args.record);
+        return false;
+    }
+    return true;
+}
+
+// Drives the scene at a fixed timestep without a window, frames go to a
+// sink instead of the screen and nothing waits on targetFPS
+static int RunHeadless(void) {
+    int result = 0;
+    bool failed = false;
+    CCCP_FrameSink *sink = NULL;
+    // Every frame time is kept, the history only covers the last few hundred
+    double *times = NULL;
+    int timesCapacity = 0;
+    CCCP_Timer *wall = CCCP_NewTimer();
+    if (!state.args.mute)
+        InitAudioDevice();
+    if (!wall || !(state.pool = CCCP_NewThreadPool(0)))
+        goto BAIL;
+    CCCP_SetThreadPool(state.pool);
+    CCCP_SetShaderUniforms(&state.uniforms);
+    if (!(state.pacing.history = CCCP_NewFrameHistory()))
+        goto BAIL;
+    CCCP_SetFrameHistory(state.pacing.history);
+    if (!(state.arena = CCCP_NewFrameArena()))
+        goto BAIL;
+    CCCP_SetFrameArena(state.arena);
+    if (!StartRecorder())
+        goto BAIL;
+    if (!(state.buffer = AcquireFramebuffer()))
+        goto BAIL;
+    if (!ReloadLibrary(state.args.path))
+        goto BAIL;
+
+    double fps = state.scene->targetFPS > 0 ? state.scene->targetFPS : TARGET_FPS;
+    double delta = 1.0 / fps;
+    if (!(sink = CCCP_OpenFrameSink(state.args.sink ? state.args.sink : "null", CCCP_SurfaceWidth(state.buffer), CCCP_SurfaceHeight(state.buffer), fps))) {
+        fprintf(stderr, "ERROR: Failed to open sink \"%s\"\n", state.args.sink ? state.args.sink : "null");
+        goto BAIL;
+    }
+
+    CCCP_Timer *frame = state.frame_timer = CCCP_NewTimer();
+    if (!frame)
+        goto BAIL;
+    CCCP_StartTimer(wall);
+    // Without a limit the run lasts until the scene quits
+    while ((state.args.frames <= 0 || (long long)state.uniforms.frame < state.args.frames) &&
+           (state.args.seconds <= 0 || state.time < state.args.seconds)) {
+        CCCP_StartTimer(frame);
+        state.time += delta;
+        state.uniforms.time = (float)state.time;
+        state.uniforms.delta = (float)delta;
+        PrepareFramebuffer(state.buffer);
+        UpdateMusic();
+        // Idle scenes keep ticking, every frame still has to be produced
+        if (state.scene->tick(state.state, state.buffer, state.audio, delta) == TICK_QUIT)
+            break;
+        state.waitFences();
+        CCCP_CaptureFrame(state.buffer, state.time);
+        state.present.previous = state.buffer;
+        if (!sink->write(sink, state.buffer, state.uniforms.frame)) {
+            fprintf(stderr, "ERROR: Failed to write frame %llu to sink\n", (unsigned long long)state.uniforms.frame);
+            failed = true;
+            break;
+        }
+        CCCP_ResetFrameArena(state.arena);
+        double work = CCCP_GetElapsedTime(frame);
+        CCCP_RecordFrame(state.pacing.history, work, work, false);
+        if (state.uniforms.frame >= (uint64_t)timesCapacity) {
+            int capacity = timesCapacity ? timesCapacity * 2 : 1024;
+            double *grown = realloc(times, capacity * sizeof(double));
+            if (!grown) {
+                fprintf(stderr, "ERROR: Out of memory recording frame times\n");
+                failed = true;
+                break;
+            }
+            times = grown;
+            timesCapacity = capacity;
+        }
+        times[state.uniforms.frame++] = work;
+    }
+
+    CCCP_RunStats stats = {
+        .frames = state.uniforms.frame,
+        .wallTime = CCCP_GetElapsedTime(wall),
+        .sceneTime = state.uniforms.frame * delta
+    };
+    CCCP_SummariseFrameTimes(times, (int)state.uniforms.frame, &stats.timing);
+    CCCP_CloseFrameSink(sink, &stats);
+    sink = NULL;
+    state.scene->deinit(state.state, state.audio);
+    result = !failed;
+
+BAIL:
+    if (sink)
+        CCCP_CloseFrameSink(sink, NULL);
+    if (state.handle)
+        dlclose(state.handle);
+    for (int i = 0; i < FRAMEBUFFER_COUNT; i++)
+        if (state.dynamic.surfaces[0][i])
+            CCCP_DestroySurface(state.dynamic.surfaces[0][i]);
+    CCCP_DestroyTimer(state.frame_timer);
+    CCCP_DestroyTimer(wall);
+    free(times);
+    CCCP_DestroyRecorder(state.recorder);
+    CCCP_DestroyFrameArena(state.arena);
+    CCCP_DestroyFrameHistory(state.pacing.history);
+    CCCP_DestroyThreadPool(state.pool);
+    if (!state.args.mute)
+        CloseAudioDevice();
+#if !defined(PLATFORM_WINDOWS)
+    free(state.args.path);
+#endif
+    return result ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
     extern char* optarg;
     extern int optopt;
     extern int optind;
     int opt;
-    while ((opt = getopt_long(argc, argv, ":w:h:t:uar", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, ":w:h:t:uardsHn:S:o:mR:b", long_options, NULL)) != -1) {
         switch (opt) {
             case 'w':
                 state.args.width = atoi(optarg);
@@ -308,6 +823,33 @@ int main(int argc, char *argv[]) {
             case 'a':
                 state.args.flags |= WINDOW_ALWAYS_ON_TOP;
                 break;
+            case 'd':
+                state.args.dynamic = 1;
+                break;
+            case 's':
+                state.args.stats = 1;
+                break;
+            case 'H':
+                state.args.headless = 1;
+                break;
+            case 'n':
+                state.args.frames = atoll(optarg);
+                break;
+            case 'S':
+                state.args.seconds = atof(optarg);
+                break;
+            case 'o':
+                state.args.sink = optarg;
+                break;
+            case 'm':
+                state.args.mute = 1;
+                break;
+            case 'R':
+                state.args.record = optarg;
+                break;
+            case 'b':
+                state.args.recordBlock = 1;
+                break;
             case ':':
                 printf("ERROR: \"-%c\" requires an value!\n", optopt);
                 usage();
@@ -355,6 +897,9 @@ int main(int argc, char *argv[]) {
     if (!state.args.title)
         state.args.title = WINDOW_TITLE;
 
+    if (state.args.headless)
+        return RunHeadless();
+
     if (!WindowOpen(800, 600, "CCCP", WINDOW_RESIZABLE)) {
         fprintf(stderr, "Failed to open window!\n");
         return 1;
@@ -364,8 +909,25 @@ int main(int argc, char *argv[]) {
 
     state.frame_timer = CCCP_NewTimer();
     CCCP_StartTimer(state.frame_timer);
+    state.stats.timer = CCCP_NewTimer();
+    CCCP_StartTimer(state.stats.timer);
+
+    if (!(state.pool = CCCP_NewThreadPool(0)))
+        return 0;
+    CCCP_SetThreadPool(state.pool);
+    CCCP_SetShaderUniforms(&state.uniforms);
+    if (!(state.pacing.history = CCCP_NewFrameHistory()))
+        return 0;
+    CCCP_SetFrameHistory(state.pacing.history);
+    if (!(state.arena = CCCP_NewFrameArena()))
+        return 0;
+    CCCP_SetFrameArena(state.arena);
+    if (!StartRecorder())
+        return 0;
 
-    if (!(state.buffer = CCCP_NewSurface(state.args.width, state.args.height, rgb(0, 0, 0))))
+    if (!StartPresentThread())
+        return 0;
+    if (!(state.buffer = AcquireFramebuffer()))
         return 0;
 
     if (!ReloadLibrary(state.args.path))
@@ -376,36 +938,86 @@ int main(int argc, char *argv[]) {
 #undef X
 
     while (WindowPoll()) {
+        // Time spent idle isn't a frame, the pacer starts over afterwards
+        bool resumed = state.idle;
+        if (resumed) {
+            if (!WaitWhileIdle())
+                break;
+            state.pacing.deadline = 0;
+        }
         double delta = CCCP_GetElapsedTime(state.frame_timer);
         CCCP_StartTimer(state.frame_timer);
-        CCCP_ClearSurface(state.buffer, state.scene->clearColor);
+        state.time += delta;
+        state.uniforms.time = (float)state.time;
+        state.uniforms.delta = (float)delta;
+        if (!(state.buffer = AcquireFramebuffer()))
+            break;
+        // Don't draw over a framebuffer the window system is still reading,
+        // the present thread only hands back slots that are done with
+        if (!state.present.threaded)
+            WindowWaitFlush();
+        PrepareFramebuffer(state.buffer);
         if (!ReloadLibrary(state.args.path))
             break;
-        // TODO: Loop through music streams and update them
-        CCCP_HashEntry* entry = state.audio->music->buckets;
-        while (entry) {
-            Music *music = (Music*)entry->value;
-            if (music && IsMusicStreamPlaying(*music))
-                UpdateMusicStream(*music);
-            entry = entry->next;
-        }
-        if (!state.scene->tick(state.state, state.buffer, state.audio, delta))
+        UpdateMusic();
+        int result = state.scene->tick(state.state, state.buffer, state.audio, delta);
+        if (result == TICK_QUIT)
             break;
-        WindowFlush(state.buffer);
+        if ((state.idle = result == TICK_IDLE))
+            state.idleSince = CCCP_GetTime();
+        // Outstanding async shader passes have to land before the frame is
+        // presented. Only those are waited on, the present thread's scale
+        // bands share the pool and draining it would serialize the two
+        state.waitFences();
+        double render = CCCP_GetElapsedTime(state.frame_timer);
+        PresentFrame(state.buffer);
+        // Temporary surfaces never reach the present thread, they're done
+        // with as soon as the frame has been handed over
+        CCCP_ResetFrameArena(state.arena);
+        state.uniforms.frame++;
+        UpdateStats(render);
         int target_fps = state.scene && state.scene->targetFPS > 0 ? state.scene->targetFPS : TARGET_FPS;
         double frame_time = 1.0 / target_fps;
-        if (delta < frame_time)
-            CCCP_Sleep(frame_time - delta);
+        int dynamic = state.args.dynamic || state.scene->dynamicResolution;
+        WindowSetSmoothScaling(dynamic);
+        double work = CCCP_GetElapsedTime(state.frame_timer);
+        if (dynamic)
+            UpdateDynamicResolution(work, frame_time);
+        // Deadlines are absolute so sleep overshoot and render time never
+        // accumulate. After a miss or a new target the schedule restarts
+        // from now rather than rushing frames out to catch up
+        double now = CCCP_GetTime();
+        if (frame_time != state.pacing.interval || !state.pacing.deadline) {
+            state.pacing.interval = frame_time;
+            state.pacing.deadline = now;
+        }
+        state.pacing.deadline += frame_time;
+        bool missed = now > state.pacing.deadline;
+        if (missed)
+            state.pacing.deadline = now;
+        else
+            CCCP_SleepUntil(state.pacing.deadline);
+        if (!resumed)
+            CCCP_RecordFrame(state.pacing.history, CCCP_GetElapsedTime(state.frame_timer), work, missed);
     }
 
     state.scene->deinit(state.state, state.audio);
     if (state.handle)
         dlclose(state.handle);
-    CCCP_DestroySurface(state.buffer);
+    StopPresentThread();
+    for (int i = 0; i < DYNAMIC_RESOLUTION_STEPS; i++)
+        for (int j = 0; j < FRAMEBUFFER_COUNT; j++)
+            if (state.dynamic.surfaces[i][j])
+                WindowDestroyFramebuffer(state.dynamic.surfaces[i][j]);
 #if !defined(PLATFORM_WINDOWS)
     free(state.args.path);
 #endif
     CCCP_DestroyTimer(state.frame_timer);
+    CCCP_DestroyTimer(state.stats.timer);
+    CCCP_DestroyRecorder(state.recorder);
+    CCCP_DestroyFrameArena(state.arena);
+    CCCP_DestroyFrameHistory(state.pacing.history);
+    CCCP_DestroyThreadPool(state.pool);
     free(state.audio);
     CCCP_DestroyHashTable(state.audio->waves);
     CCCP_DestroyHashTable(state.audio->sounds);
@@ -0,0 +1,113 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cccp.h"
+
+struct CCCP_FrameHistory {
+    double frame[CCCP_FRAME_HISTORY];
+    double work[CCCP_FRAME_HISTORY];
+    bool missed[CCCP_FRAME_HISTORY];
+    int next, count;
+    uint64_t total_missed;
+};
+
+static CCCP_FrameHistory *current_history = NULL;
+
+CCCP_FrameHistory* CCCP_NewFrameHistory(void) {
+    return calloc(1, sizeof(CCCP_FrameHistory));
+}
+
+void CCCP_DestroyFrameHistory(CCCP_FrameHistory *history) {
+    if (!history)
+        return;
+    if (current_history == history)
+        current_history = NULL;
+    free(history);
+}
+
+void CCCP_RecordFrame(CCCP_FrameHistory *history, double frameTime, double workTime, bool missed) {
+    if (!history)
+        return;
+    history->frame[history->next] = frameTime;
+    history->work[history->next] = workTime;
+    history->missed[history->next] = missed;
+    history->next = (history->next + 1) % CCCP_FRAME_HISTORY;
+    if (history->count < CCCP_FRAME_HISTORY)
+        history->count++;
+    if (missed)
+        history->total_missed++;
+}
+
+void CCCP_SetFrameHistory(CCCP_FrameHistory *history) {
+    current_history = history;
+}
+
+CCCP_FrameHistory* CCCP_GetFrameHistory(void) {
+    return current_history;
+}
+
+static int CCCP_CompareTimes(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Fills the fields that only depend on the frame times, sorts them in place
+static void CCCP_SummariseTimes(double *times, int count, CCCP_FrameStats *stats) {
+    double total = 0;
+    for (int i = 0; i < count; i++)
+        total += times[i];
+    qsort(times, count, sizeof(double), CCCP_CompareTimes);
+    stats->frames = count;
+    stats->average = total / count;
+    stats->p50 = times[(count - 1) / 2];
+    stats->p99 = times[(int)ceil(count * .99) - 1];
+    stats->worst = times[count - 1];
+}
+
+bool CCCP_GetFrameStats(CCCP_FrameStats *stats) {
+    CCCP_FrameHistory *history = current_history;
+    if (!stats || !history || !history->count)
+        return false;
+    int count = history->count;
+    double sorted[CCCP_FRAME_HISTORY];
+    double work = 0;
+    int missed = 0;
+    // Not full yet means nothing has wrapped, the frames start at 0
+    for (int i = 0; i < count; i++) {
+        sorted[i] = history->frame[i];
+        work += history->work[i];
+        missed += history->missed[i];
+    }
+    CCCP_SummariseTimes(sorted, count, stats);
+    stats->work = work / count;
+    stats->missed = missed;
+    stats->totalMissed = history->total_missed;
+    return true;
+}
+
+bool CCCP_SummariseFrameTimes(double *times, int count, CCCP_FrameStats *stats) {
+    if (!stats || !times || count <= 0)
+        return false;
+    CCCP_SummariseTimes(times, count, stats);
+    // Frames that never sleep spend all their time working
+    stats->work = stats->average;
+    stats->missed = 0;
+    stats->totalMissed = 0;
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cccp.h"
+
+struct CCCP_ThreadPool {
+    thrd_pool_t *pool;
+    int thread_count;
+    // Workers must always be torn down by the module that created the pool,
+    // scene libraries get unloaded while the runtime's threads keep running
+    void(*destroy)(thrd_pool_t*);
+};
+
+static CCCP_ThreadPool *current_pool = NULL;
+
+static int CCCP_ThreadCount(int numThreads) {
+    if (numThreads > 0)
+        return numThreads;
+    int count = (int)thread_hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+CCCP_ThreadPool* CCCP_NewThreadPool(int numThreads) {
+    CCCP_ThreadPool *pool = malloc(sizeof(CCCP_ThreadPool));
+    if (!pool)
+        return NULL;
+    pool->thread_count = CCCP_ThreadCount(numThreads);
+    pool->destroy = thrd_pool_destroy;
+    if (!(pool->pool = thrd_pool_create(pool->thread_count, 0))) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void CCCP_DestroyThreadPool(CCCP_ThreadPool *pool) {
+    if (!pool)
+        return;
+    if (current_pool == pool)
+        current_pool = NULL;
+    thrd_pool_wait(pool->pool);
+    pool->destroy(pool->pool);
+    free(pool);
+}
+
+int CCCP_ThreadPoolSize(CCCP_ThreadPool *pool) {
+    return pool ? pool->thread_count : 0;
+}
+
+bool CCCP_ThreadPoolSubmit(CCCP_ThreadPool *pool, void(*func)(void*), void *arg) {
+    return pool && thrd_pool_submit(pool->pool, func, arg, NULL) == thrd_success;
+}
+
+void CCCP_ThreadPoolWait(CCCP_ThreadPool *pool) {
+    if (pool)
+        thrd_pool_wait(pool->pool);
+}
+
+bool CCCP_ThreadPoolHelp(CCCP_ThreadPool *pool) {
+    return pool && thrd_pool_help(pool->pool);
+}
+
+void CCCP_ThreadPoolWaitFor(CCCP_ThreadPool *pool, atomic_int *counter) {
+    while (atomic_load(counter) > 0)
+        if (!CCCP_ThreadPoolHelp(pool))
+            thrd_yield();
+}
+
+void CCCP_SetThreadPool(CCCP_ThreadPool *pool) {
+    current_pool = pool;
+}
+
+CCCP_ThreadPool* CCCP_GetThreadPool(void) {
+    return current_pool;
+}
@@ -0,0 +1,498 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cccp.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// surface.c already pulled in qoi with its implementation in cccp.c builds
+#ifndef QOI_H
+#include "qoi.h"
+#endif
+#include <stdio.h>
+
+#define RECORD_RING 8
+#define MAX_ENCODERS 4
+#define GIF_HASH_SIZE 8192
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_COPYING,
+    SLOT_FILLED,
+    SLOT_ENCODING
+} RecordSlotState;
+
+typedef struct {
+    CCCP_Surface surface;
+    uint64_t index;
+    double time;
+    RecordSlotState state;
+} RecordSlot;
+
+// Sub-block packing and the LZW dictionary for one GIF frame
+typedef struct {
+    FILE *file;
+    uint8_t block[255];
+    int length;
+    uint32_t bits;
+    int count;
+    int32_t keys[GIF_HASH_SIZE];
+    int16_t codes[GIF_HASH_SIZE];
+} GifWriter;
+
+struct CCCP_Recorder {
+    // Same arrangement as the thread pool, encoders must always run the
+    // code of the module that created the recorder
+    int(*encoder)(void*);
+    mtx_t lock;
+    cnd_t filled, freed;
+    RecordSlot slots[RECORD_RING];
+    thrd_t threads[MAX_ENCODERS];
+    int thread_count;
+    bool recording, stopping, failed;
+    CCCP_RecordFormat format;
+    CCCP_RecordBackpressure backpressure;
+    char *path;
+    uint64_t next_index, written, dropped;
+    // Only touched by the GIF encoder, there's only ever one
+    FILE *gif;
+    int gif_width, gif_height;
+    double gif_time;
+    uint8_t *gif_indices;
+    GifWriter *gif_writer;
+};
+
+static CCCP_Recorder *current_recorder = NULL;
+
+static void CCCP_GifPutCode(GifWriter *writer, int code, int size) {
+    writer->bits |= (uint32_t)code << writer->count;
+    writer->count += size;
+    while (writer->count >= 8) {
+        writer->block[writer->length++] = writer->bits & 0xFF;
+        writer->bits >>= 8;
+        writer->count -= 8;
+        if (writer->length == 255) {
+            fputc(255, writer->file);
+            fwrite(writer->block, 1, 255, writer->file);
+            writer->length = 0;
+        }
+    }
+}
+
+static void CCCP_GifFinishCodes(GifWriter *writer) {
+    if (writer->count > 0)
+        CCCP_GifPutCode(writer, 0, 8 - writer->count);
+    if (writer->length) {
+        fputc(writer->length, writer->file);
+        fwrite(writer->block, 1, writer->length, writer->file);
+    }
+    fputc(0, writer->file);
+}
+
+static int CCCP_GifFind(GifWriter *writer, int32_t key, bool *found) {
+    uint32_t slot = ((uint32_t)key * 2654435761u) >> 19;
+    while (writer->keys[slot] && writer->keys[slot] != key)
+        slot = (slot + 1) & (GIF_HASH_SIZE - 1);
+    *found = writer->keys[slot] == key;
+    return (int)slot;
+}
+
+// Codes grow from 9 to 12 bits, the dictionary restarts once it's full
+static void CCCP_GifCompress(GifWriter *writer, const uint8_t *indices, int count) {
+    const int clear = 256, end = 257;
+    int size = 9, max_code = end;
+    memset(writer->keys, 0, sizeof(writer->keys));
+    writer->length = writer->count = 0;
+    writer->bits = 0;
+    fputc(8, writer->file);
+    CCCP_GifPutCode(writer, clear, size);
+    int prefix = indices[0];
+    for (int i = 1; i < count; i++) {
+        // Keys are offset by one, zero marks an empty slot
+        int32_t key = ((prefix << 8) | indices[i]) + 1;
+        bool found;
+        int slot = CCCP_GifFind(writer, key, &found);
+        if (found) {
+            prefix = writer->codes[slot];
+            continue;
+        }
+        CCCP_GifPutCode(writer, prefix, size);
+        writer->keys[slot] = key;
+        writer->codes[slot] = (int16_t)++max_code;
+        if (max_code >= (1 << size))
+            size++;
+        if (max_code == 4095) {
+            CCCP_GifPutCode(writer, clear, size);
+            memset(writer->keys, 0, sizeof(writer->keys));
+            size = 9;
+            max_code = end;
+        }
+        prefix = indices[i];
+    }
+    CCCP_GifPutCode(writer, prefix, size);
+    CCCP_GifPutCode(writer, end, size);
+    CCCP_GifFinishCodes(writer);
+}
+
+static int CCCP_CompareBins(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x < y) - (x > y);
+}
+
+// Popularity palette over 4 bits per channel, the 256 busiest bins become
+// the palette and every other bin maps to its nearest entry
+static void CCCP_GifQuantize(const color_t *pixels, int count, uint8_t palette[256][3], uint8_t *indices) {
+    static _Thread_local uint32_t histogram[4096];
+    static _Thread_local uint32_t bins[4096];
+    static _Thread_local uint8_t lookup[4096];
+    memset(histogram, 0, sizeof(histogram));
+    for (int i = 0; i < count; i++)
+        histogram[((pixels[i].r >> 4) << 8) | ((pixels[i].g >> 4) << 4) | (pixels[i].b >> 4)]++;
+    int used = 0;
+    // Counts in the top bits so a plain sort ranks the bins
+    for (int i = 0; i < 4096; i++)
+        if (histogram[i])
+            bins[used++] = (histogram[i] > 0xFFFFF ? 0xFFFFF : histogram[i]) << 12 | i;
+    qsort(bins, used, sizeof(uint32_t), CCCP_CompareBins);
+    int colors = used < 256 ? used : 256;
+    memset(palette, 0, 256 * 3);
+    for (int i = 0; i < colors; i++) {
+        int bin = bins[i] & 0xFFF;
+        palette[i][0] = (bin >> 8) * 17;
+        palette[i][1] = ((bin >> 4) & 0xF) * 17;
+        palette[i][2] = (bin & 0xF) * 17;
+        lookup[bin] = i;
+    }
+    for (int i = colors; i < used; i++) {
+        int bin = bins[i] & 0xFFF;
+        int r = (bin >> 8) * 17, g = ((bin >> 4) & 0xF) * 17, b = (bin & 0xF) * 17;
+        int best = 0, distance = INT_MAX;
+        for (int j = 0; j < colors; j++) {
+            int dr = r - palette[j][0], dg = g - palette[j][1], db = b - palette[j][2];
+            int d = dr * dr + dg * dg + db * db;
+            if (d < distance) {
+                distance = d;
+                best = j;
+            }
+        }
+        lookup[bin] = best;
+    }
+    for (int i = 0; i < count; i++)
+        indices[i] = lookup[((pixels[i].r >> 4) << 8) | ((pixels[i].g >> 4) << 4) | (pixels[i].b >> 4)];
+}
+
+static void CCCP_GifPutShort(FILE *file, int value) {
+    fputc(value & 0xFF, file);
+    fputc((value >> 8) & 0xFF, file);
+}
+
+// 1 written, 0 skipped, -1 failed
+static int CCCP_EncodeGifFrame(CCCP_Recorder *recorder, RecordSlot *slot) {
+    int w = CCCP_SurfaceWidth(slot->surface), h = CCCP_SurfaceHeight(slot->surface);
+    FILE *file = recorder->gif;
+    if (!recorder->gif_width) {
+        if (!(recorder->gif_indices = malloc(w * h)) || !(recorder->gif_writer = malloc(sizeof(GifWriter))))
+            return -1;
+        recorder->gif_writer->file = file;
+        recorder->gif_width = w;
+        recorder->gif_height = h;
+        recorder->gif_time = slot->time;
+        fwrite("GIF89a", 1, 6, file);
+        CCCP_GifPutShort(file, w);
+        CCCP_GifPutShort(file, h);
+        fwrite("\x00\x00\x00", 1, 3, file);
+        // Loop forever
+        fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, file);
+    }
+    // The canvas is fixed by the first frame
+    if (w != recorder->gif_width || h != recorder->gif_height)
+        return 0;
+    // Frames carry the interval that led up to them, in whole hundredths
+    // kept in step with the scene clock so rounding never drifts
+    int delay = (int)(slot->time * 100.0 + .5) - (int)(recorder->gif_time * 100.0 + .5);
+    if (delay > 0)
+        recorder->gif_time = slot->time;
+    if (delay < 2)
+        delay = 2;
+    uint8_t palette[256][3];
+    CCCP_GifQuantize(slot->surface, w * h, palette, recorder->gif_indices);
+    fwrite("\x21\xF9\x04\x04", 1, 4, file);
+    CCCP_GifPutShort(file, delay);
+    fwrite("\x00\x00", 1, 2, file);
+    fputc(0x2C, file);
+    CCCP_GifPutShort(file, 0);
+    CCCP_GifPutShort(file, 0);
+    CCCP_GifPutShort(file, w);
+    CCCP_GifPutShort(file, h);
+    fputc(0x87, file);
+    fwrite(palette, 1, sizeof(palette), file);
+    CCCP_GifCompress(recorder->gif_writer, recorder->gif_indices, w * h);
+    return ferror(file) ? -1 : 1;
+}
+
+static int CCCP_EncodeImage(CCCP_Recorder *recorder, RecordSlot *slot) {
+    int w = CCCP_SurfaceWidth(slot->surface), h = CCCP_SurfaceHeight(slot->surface);
+    size_t length = strlen(recorder->path) + 32;
+    char *name = malloc(length);
+    if (!name)
+        return -1;
+    const char *extension = recorder->format == RECORD_PNG ? "png" : "qoi";
+    if (strchr(recorder->path, '%'))
+        snprintf(name, length, recorder->path, (int)slot->index);
+    else
+        snprintf(name, length, "%s%06d.%s", recorder->path, (int)slot->index, extension);
+    bool result;
+    if (recorder->format == RECORD_PNG)
+        result = stbi_write_png(name, w, h, 4, slot->surface, w * 4);
+    else
+        result = qoi_write(name, slot->surface, &(qoi_desc) {
+            .width = w,
+            .height = h,
+            .channels = 4,
+            .colorspace = QOI_SRGB
+        }) > 0;
+    free(name);
+    return result ? 1 : -1;
+}
+
+static RecordSlot* CCCP_FindSlot(CCCP_Recorder *recorder, RecordSlotState state) {
+    RecordSlot *found = NULL;
+    // Filled slots are taken oldest first, the GIF encoder relies on it
+    for (int i = 0; i < RECORD_RING; i++)
+        if (recorder->slots[i].state == state && (!found || recorder->slots[i].index < found->index))
+            found = &recorder->slots[i];
+    return found;
+}
+
+static int CCCP_EncoderThread(void *arg) {
+    CCCP_Recorder *recorder = (CCCP_Recorder*)arg;
+    mtx_lock(&recorder->lock);
+    for (;;) {
+        RecordSlot *slot = CCCP_FindSlot(recorder, SLOT_FILLED);
+        if (!slot) {
+            // Whatever was buffered still gets written after a stop
+            if (recorder->stopping)
+                break;
+            cnd_wait(&recorder->filled, &recorder->lock);
+            continue;
+        }
+        slot->state = SLOT_ENCODING;
+        mtx_unlock(&recorder->lock);
+        int result = recorder->format == RECORD_GIF ? CCCP_EncodeGifFrame(recorder, slot) : CCCP_EncodeImage(recorder, slot);
+        mtx_lock(&recorder->lock);
+        if (result > 0)
+            recorder->written++;
+        else if (!result)
+            recorder->dropped++;
+        else
+            recorder->failed = true;
+        slot->state = SLOT_FREE;
+        cnd_broadcast(&recorder->freed);
+    }
+    mtx_unlock(&recorder->lock);
+    return 0;
+}
+
+CCCP_Recorder* CCCP_NewRecorder(void) {
+    CCCP_Recorder *recorder = calloc(1, sizeof(CCCP_Recorder));
+    if (!recorder)
+        return NULL;
+    recorder->encoder = CCCP_EncoderThread;
+    if (mtx_init(&recorder->lock, mtx_plain) != thrd_success)
+        goto BAIL;
+    if (cnd_init(&recorder->filled) != thrd_success) {
+        mtx_destroy(&recorder->lock);
+        goto BAIL;
+    }
+    if (cnd_init(&recorder->freed) != thrd_success) {
+        cnd_destroy(&recorder->filled);
+        mtx_destroy(&recorder->lock);
+        goto BAIL;
+    }
+    return recorder;
+
+BAIL:
+    free(recorder);
+    return NULL;
+}
+
+static void CCCP_StopRecorder(CCCP_Recorder *recorder) {
+    mtx_lock(&recorder->lock);
+    recorder->recording = false;
+    recorder->stopping = true;
+    cnd_broadcast(&recorder->filled);
+    cnd_broadcast(&recorder->freed);
+    mtx_unlock(&recorder->lock);
+    for (int i = 0; i < recorder->thread_count; i++)
+        thrd_join(recorder->threads[i], NULL);
+    recorder->thread_count = 0;
+    recorder->stopping = false;
+    if (recorder->gif) {
+        if (recorder->gif_width)
+            fputc(0x3B, recorder->gif);
+        if (fclose(recorder->gif))
+            recorder->failed = true;
+        recorder->gif = NULL;
+    }
+    if (recorder->gif_indices)
+        free(recorder->gif_indices);
+    if (recorder->gif_writer)
+        free(recorder->gif_writer);
+    recorder->gif_indices = NULL;
+    recorder->gif_writer = NULL;
+    recorder->gif_width = recorder->gif_height = 0;
+    if (recorder->path)
+        free(recorder->path);
+    recorder->path = NULL;
+}
+
+static bool CCCP_StartRecorder(CCCP_Recorder *recorder, const char *path, CCCP_RecordFormat format) {
+    CCCP_StopRecorder(recorder);
+    if (!path || !(recorder->path = strdup(path)))
+        return false;
+    recorder->format = format;
+    recorder->next_index = recorder->written = recorder->dropped = 0;
+    recorder->failed = false;
+    if (format == RECORD_GIF && !(recorder->gif = fopen(path, "wb")))
+        goto BAIL;
+    // Sequence frames are independent and can be written side by side
+    int count = 1;
+    if (format != RECORD_GIF) {
+        count = (int)thread_hardware_concurrency() / 2;
+        count = count < 1 ? 1 : count > MAX_ENCODERS ? MAX_ENCODERS : count;
+    }
+    recorder->recording = true;
+    for (int i = 0; i < count; i++) {
+        if (thrd_create(&recorder->threads[i], recorder->encoder, recorder) != thrd_success)
+            goto BAIL;
+        recorder->thread_count++;
+    }
+    return true;
+
+BAIL:
+    CCCP_StopRecorder(recorder);
+    return false;
+}
+
+void CCCP_DestroyRecorder(CCCP_Recorder *recorder) {
+    if (!recorder)
+        return;
+    if (current_recorder == recorder)
+        current_recorder = NULL;
+    CCCP_StopRecorder(recorder);
+    for (int i = 0; i < RECORD_RING; i++)
+        if (recorder->slots[i].surface)
+            CCCP_DestroySurface(recorder->slots[i].surface);
+    cnd_destroy(&recorder->freed);
+    cnd_destroy(&recorder->filled);
+    mtx_destroy(&recorder->lock);
+    free(recorder);
+}
+
+void CCCP_SetRecorder(CCCP_Recorder *recorder) {
+    current_recorder = recorder;
+}
+
+CCCP_Recorder* CCCP_GetRecorder(void) {
+    return current_recorder;
+}
+
+bool CCCP_StartRecording(const char *path, CCCP_RecordFormat format) {
+    return current_recorder && CCCP_StartRecorder(current_recorder, path, format);
+}
+
+void CCCP_StopRecording(void) {
+    if (current_recorder)
+        CCCP_StopRecorder(current_recorder);
+}
+
+bool CCCP_IsRecording(void) {
+    if (!current_recorder)
+        return false;
+    mtx_lock(&current_recorder->lock);
+    bool result = current_recorder->recording;
+    mtx_unlock(&current_recorder->lock);
+    return result;
+}
+
+void CCCP_SetRecordingBackpressure(CCCP_RecordBackpressure mode) {
+    if (!current_recorder)
+        return;
+    mtx_lock(&current_recorder->lock);
+    current_recorder->backpressure = mode;
+    mtx_unlock(&current_recorder->lock);
+}
+
+bool CCCP_CaptureFrame(CCCP_Surface frame, double time) {
+    CCCP_Recorder *recorder = current_recorder;
+    if (!recorder || !frame)
+        return false;
+    int w = CCCP_SurfaceWidth(frame), h = CCCP_SurfaceHeight(frame);
+    mtx_lock(&recorder->lock);
+    RecordSlot *slot = NULL;
+    while (recorder->recording && !(slot = CCCP_FindSlot(recorder, SLOT_FREE)) && recorder->backpressure == RECORD_BLOCK)
+        cnd_wait(&recorder->freed, &recorder->lock);
+    if (!recorder->recording) {
+        mtx_unlock(&recorder->lock);
+        return false;
+    }
+    if (!slot) {
+        recorder->dropped++;
+        mtx_unlock(&recorder->lock);
+        return false;
+    }
+    slot->state = SLOT_COPYING;
+    mtx_unlock(&recorder->lock);
+
+    // Buffers are only reallocated when the frame size changes
+    if (slot->surface && (CCCP_SurfaceWidth(slot->surface) != w || CCCP_SurfaceHeight(slot->surface) != h)) {
+        CCCP_DestroySurface(slot->surface);
+        slot->surface = NULL;
+    }
+    if (!slot->surface)
+        slot->surface = CCCP_NewSurface(w, h, rgb(0, 0, 0));
+    if (slot->surface)
+        memcpy(slot->surface, frame, w * h * sizeof(color_t));
+
+    bool copied = slot->surface != NULL;
+    mtx_lock(&recorder->lock);
+    if (copied) {
+        slot->index = recorder->next_index++;
+        slot->time = time;
+        slot->state = SLOT_FILLED;
+        cnd_signal(&recorder->filled);
+    } else {
+        slot->state = SLOT_FREE;
+        recorder->dropped++;
+    }
+    mtx_unlock(&recorder->lock);
+    return copied;
+}
+
+bool CCCP_GetRecordingStats(uint64_t *written, uint64_t *dropped) {
+    if (!current_recorder)
+        return false;
+    mtx_lock(&current_recorder->lock);
+    if (written)
+        *written = current_recorder->written;
+    if (dropped)
+        *dropped = current_recorder->dropped;
+    bool result = !current_recorder->failed;
+    mtx_unlock(&current_recorder->lock);
+    return result;
+}
@@ -21,13 +21,59 @@
 
 #define CHUNK_WIDTH 64
 #define CHUNK_HEIGHT 64
+#define MAX_FENCES 64
 
+static const vec4 lanes4 = { 0.f, 1.f, 2.f, 3.f };
+static const vec8 lanes8 = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f };
+
+static const CCCP_ShaderUniforms *frame_uniforms = NULL;
+
+// Clamp to [0, 1] then scale to [0, 255], all lanes at once. The clamp has
+// to happen on the floats, converting NaN or huge values is undefined, NaN
+// fails both compares and ends up 0, 0x3F800000 is 1.0f
+#define X(N)                                                            \
+    static inline uvec##N pack_channel##N(vec##N v) {                   \
+        ivec##N above = v > 0.f, below = v < 1.f;                       \
+        v = (vec##N)(((ivec##N)v & above & below) | (above & ~below & 0x3F800000)); \
+        return __builtin_convertvector(v * 255.f + .5f, uvec##N);       \
+    }                                                                   \
+    static inline void pack_packet##N(color_t *dst, int count, CCCP_ColorPacket##N c) { \
+        uvec##N packed = pack_channel##N(c.r)                           \
+                       | pack_channel##N(c.g) << 8                      \
+                       | pack_channel##N(c.b) << 16                     \
+                       | pack_channel##N(c.a) << 24;                    \
+        memcpy(dst, &packed, count * sizeof(color_t));                  \
+    }
+X(4)
+X(8)
+#undef X
+
+// Shared by every worker of a single CCCP_ApplyShader call, workers claim
+// tiles by bumping next_tile so dispatching a pass never allocates
 typedef struct {
-    int x, y, w, h;
+    atomic_int *remaining; // Outstanding workers of an async dispatch
     void *userdata;
     CCCP_ShaderFunc func;
-    CCCP_Surface surface;
-} ShaderJob;
+    CCCP_ShaderTileFunc tile;
+    CCCP_ShaderFunc4 func4;
+    CCCP_ShaderFunc8 func8;
+    CCCP_SurfaceView view;
+    const CCCP_ShaderUniforms *uniforms;
+    int w, h;
+    int tiles_x, tile_count;
+    atomic_int next_tile;
+} ShaderDispatch;
+
+// Async dispatches live in a fixed table, a CCCP_Fence is the slot index
+// plus the generation it was claimed with so stale handles read as done
+typedef struct {
+    ShaderDispatch dispatch;
+    CCCP_ShaderUniforms uniforms;
+    atomic_int remaining;
+    atomic_uint generation;
+} ShaderFence;
+
+static ShaderFence fences[MAX_FENCES];
 
 CCCP_Shader CCCP_NewShader(CCCP_ShaderFunc func, int numThreads) {
     return (CCCP_Shader){
@@ -36,51 +82,417 @@ CCCP_Shader CCCP_NewShader(CCCP_ShaderFunc func, int numThreads) {
     };
 }
 
+CCCP_Shader CCCP_NewTileShader(CCCP_ShaderFunc func, CCCP_ShaderTileFunc tile, int numThreads) {
+    return (CCCP_Shader){
+        .func = func,
+        .tile = tile,
+        .thread_count = numThreads <= 0 ? thread_hardware_concurrency() : numThreads
+    };
+}
+
+CCCP_Shader CCCP_NewShader4(CCCP_ShaderFunc4 func, int numThreads) {
+    return (CCCP_Shader){
+        .func4 = func,
+        .thread_count = numThreads <= 0 ? thread_hardware_concurrency() : numThreads
+    };
+}
+
+CCCP_Shader CCCP_NewShader8(CCCP_ShaderFunc8 func, int numThreads) {
+    return (CCCP_Shader){
+        .func8 = func,
+        .thread_count = numThreads <= 0 ? thread_hardware_concurrency() : numThreads
+    };
+}
+
 void CCCP_DestroyShader(CCCP_Shader *shader) {
     memset(shader, 0, sizeof(CCCP_Shader));
 }
 
-static void CCCP_ShaderWorker(void *arg) {
-    ShaderJob *job = (ShaderJob*)arg;
-    int w = CCCP_SurfaceWidth(job->surface);
-    int h = CCCP_SurfaceHeight(job->surface);
-    for (int y = job->y; y < job->y + job->h && y < h; ++y)
-        for (int x = job->x; x < job->x + job->w && x < w; ++x) {
+#define X(N)                                                                        \
+    static void CCCP_ShadeTile##N(ShaderDispatch *dispatch, int tx, int ty, int tw, int th) { \
+        for (int y = ty; y < ty + th; ++y) {                                        \
+            color_t *row = dispatch->view.pixels + y * dispatch->view.stride;      \
+            vec##N fy = (vec##N){0} + ((float)y + 0.5f);                            \
+            for (int x = tx; x < tx + tw; x += N) {                                 \
+                vec##N fx = lanes##N + ((float)x + 0.5f);                           \
+                CCCP_ColorPacket##N color = dispatch->func##N(fx, fy, dispatch->uniforms, dispatch->userdata); \
+                int count = tx + tw - x;                                            \
+                pack_packet##N(row + x, count < N ? count : N, color);              \
+            }                                                                       \
+        }                                                                           \
+    }
+X(4)
+X(8)
+#undef X
+
+static void CCCP_ShadeTile(ShaderDispatch *dispatch, int tx, int ty, int tw, int th) {
+    for (int y = ty; y < ty + th; ++y) {
+        color_t *row = dispatch->view.pixels + y * dispatch->view.stride;
+        for (int x = tx; x < tx + tw; ++x) {
             vec2 fragcoord = { (float)x + 0.5f, (float)y + 0.5f };
-            vec2 resolution = { (float)w, (float)h };
-            vec4 color = job->func(fragcoord, resolution, 0.f, job->userdata);
-            // Convert normalized float color to uint8_t color
-            color_t final = rgbaf_to_rgba((color_rgbaf_t){color[0], color[1], color[2], color[3]});
-            CCCP_SetPixel(job->surface, x, y, final);
+            row[x] = CCCP_PackColor(dispatch->func(fragcoord, dispatch->uniforms, dispatch->userdata));
+        }
+    }
+}
+
+static void CCCP_ShaderWorker(void *arg) {
+    ShaderDispatch *dispatch = (ShaderDispatch*)arg;
+    int tile;
+    while ((tile = atomic_fetch_add(&dispatch->next_tile, 1)) < dispatch->tile_count) {
+        int tx = (tile % dispatch->tiles_x) * CHUNK_WIDTH;
+        int ty = (tile / dispatch->tiles_x) * CHUNK_HEIGHT;
+        int tw = tx + CHUNK_WIDTH > dispatch->w ? dispatch->w - tx : CHUNK_WIDTH;
+        int th = ty + CHUNK_HEIGHT > dispatch->h ? dispatch->h - ty : CHUNK_HEIGHT;
+        if (dispatch->tile)
+            dispatch->tile(&(CCCP_ShaderTile) {
+                .surface = dispatch->view.surface,
+                .pixels = dispatch->view.pixels,
+                .stride = dispatch->view.stride,
+                .x = tx, .y = ty, .w = tw, .h = th,
+                .uniforms = dispatch->uniforms,
+                .userdata = dispatch->userdata
+            });
+        else if (dispatch->func8)
+            CCCP_ShadeTile8(dispatch, tx, ty, tw, th);
+        else if (dispatch->func4)
+            CCCP_ShadeTile4(dispatch, tx, ty, tw, th);
+        else
+            CCCP_ShadeTile(dispatch, tx, ty, tw, th);
+    }
+    // Must be the last access, the fence slot may be reused straight after
+    if (dispatch->remaining)
+        atomic_fetch_sub(dispatch->remaining, 1);
+}
+
+void CCCP_SetShaderUniforms(const CCCP_ShaderUniforms *uniforms) {
+    frame_uniforms = uniforms;
+}
+
+static bool CCCP_IsValidShader(const CCCP_SurfaceView *view, CCCP_Shader *shader) {
+    return view->pixels && shader && (shader->func || shader->tile || shader->func4 || shader->func8);
+}
+
+static void CCCP_PrepareDispatch(ShaderDispatch *dispatch, CCCP_ShaderUniforms *uniforms, CCCP_SurfaceView view, CCCP_Shader *shader, void *userdata) {
+    *uniforms = frame_uniforms ? *frame_uniforms : (CCCP_ShaderUniforms){0};
+    dispatch->remaining = NULL;
+    dispatch->userdata = userdata;
+    dispatch->func = shader->func;
+    dispatch->tile = shader->tile;
+    dispatch->func4 = shader->func4;
+    dispatch->func8 = shader->func8;
+    dispatch->view = view;
+    dispatch->uniforms = uniforms;
+    dispatch->w = view.w;
+    dispatch->h = view.h;
+    dispatch->tiles_x = (dispatch->w + CHUNK_WIDTH - 1) / CHUNK_WIDTH;
+    dispatch->tile_count = dispatch->tiles_x * ((dispatch->h + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT);
+    atomic_store(&dispatch->next_tile, 0);
+    uniforms->resolution = (vec2){ (float)dispatch->w, (float)dispatch->h };
+    // Every tile gets written, marked up front so workers never touch the tracker
+    CCCP_MarkDirty(view.surface, view.x, view.y, view.w, view.h);
+}
+
+// One job per thread, each keeps claiming tiles until none are left. A
+// shader's thread count only caps how many jobs it gets, resizing the pool
+// would respawn every worker whenever shaders with different counts alternate.
+// The submitting thread counts as one when it joins in. On failure the
+// jobs already out still run, the rest of the tiles are left unclaimed
+static bool CCCP_SubmitDispatch(CCCP_ThreadPool *pool, ShaderDispatch *dispatch, int threads, bool joining) {
+    int workers = CCCP_ThreadPoolSize(pool);
+    if (threads > 0 && workers > threads - joining)
+        workers = threads - joining;
+    if (workers > dispatch->tile_count - joining)
+        workers = dispatch->tile_count - joining;
+    if (workers <= 0)
+        return true;
+    if (dispatch->remaining)
+        atomic_fetch_add(dispatch->remaining, workers);
+    for (int i = 0; i < workers; ++i)
+        if (!CCCP_ThreadPoolSubmit(pool, CCCP_ShaderWorker, dispatch)) {
+            if (dispatch->remaining)
+                atomic_fetch_sub(dispatch->remaining, workers - i);
+            return false;
         }
-    free(job);
+    return true;
 }
 
 bool CCCP_ApplyShader(CCCP_Surface surface, CCCP_Shader *shader, void* userdata) {
-    thrd_pool_t *pool = thrd_pool_create(shader->thread_count <= 0 ? thread_hardware_concurrency() : shader->thread_count, 0);
-    int w = CCCP_SurfaceWidth(surface);
-    int h = CCCP_SurfaceHeight(surface);
-    int nx = (w + CHUNK_WIDTH - 1) / CHUNK_WIDTH;
-    int ny = (h + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT;
-    bool result = false;
-    for (int j = 0; j < ny; ++j) {
-        for (int i = 0; i < nx; ++i) {
-            ShaderJob *job = malloc(sizeof(ShaderJob));
-            if (!job)
-                goto BAIL;
-            job->x = i * CHUNK_WIDTH;
-            job->y = j * CHUNK_HEIGHT;
-            job->w = job->x + CHUNK_WIDTH > w ? w - job->x : CHUNK_WIDTH;
-            job->h = job->y + CHUNK_HEIGHT > h ? h - job->y : CHUNK_HEIGHT;
-            job->userdata = userdata;
-            job->func = shader->func;
-            job->surface = surface;
-            thrd_pool_submit(pool, CCCP_ShaderWorker, job, NULL);
+    return CCCP_ApplyShaderView(CCCP_SurfaceAsView(surface), shader, userdata);
+}
+
+bool CCCP_ApplyShaderView(CCCP_SurfaceView view, CCCP_Shader *shader, void* userdata) {
+    if (!CCCP_IsValidShader(&view, shader))
+        return false;
+    // Prefer the runtime's pool, only spin up a temporary one when the
+    // shader is used outside of cccp (e.g. a standalone tool)
+    CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+    bool owned = false;
+    if (!pool) {
+        if (!(pool = CCCP_NewThreadPool(shader->thread_count)))
+            return false;
+        owned = true;
+    }
+    ShaderDispatch dispatch;
+    CCCP_ShaderUniforms uniforms;
+    atomic_int remaining;
+    CCCP_PrepareDispatch(&dispatch, &uniforms, view, shader, userdata);
+    // This thread shades too, picking up whatever couldn't be submitted. Only
+    // this pass is waited on, not other fences or the present thread's work
+    atomic_store(&remaining, 1);
+    dispatch.remaining = &remaining;
+    CCCP_SubmitDispatch(pool, &dispatch, shader->thread_count, true);
+    CCCP_ShaderWorker(&dispatch);
+    CCCP_ThreadPoolWaitFor(pool, &remaining);
+    if (owned)
+        CCCP_DestroyThreadPool(pool);
+    return true;
+}
+
+static ShaderFence* CCCP_ClaimFence(int *index) {
+    for (;;) {
+        for (int i = 0; i < MAX_FENCES; ++i) {
+            int expected = 0;
+            // Hold one count while the dispatch is being set up
+            if (atomic_compare_exchange_strong(&fences[i].remaining, &expected, 1)) {
+                *index = i;
+                return &fences[i];
+            }
         }
+        // Every slot is in flight, help them along until one retires
+        CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+        if (!pool || !CCCP_ThreadPoolHelp(pool))
+            thrd_yield();
     }
-    result = true;
-BAIL:
-    thrd_pool_wait(pool);
-    thrd_pool_destroy(pool);
+}
+
+CCCP_Fence CCCP_ApplyShaderAsync(CCCP_Surface surface, CCCP_Shader *shader, void* userdata) {
+    return CCCP_ApplyShaderViewAsync(CCCP_SurfaceAsView(surface), shader, userdata);
+}
+
+CCCP_Fence CCCP_ApplyShaderViewAsync(CCCP_SurfaceView view, CCCP_Shader *shader, void* userdata) {
+    if (!CCCP_IsValidShader(&view, shader))
+        return 0;
+    CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+    int index;
+    ShaderFence *fence = CCCP_ClaimFence(&index);
+    unsigned int generation = atomic_fetch_add(&fence->generation, 1) + 1;
+    CCCP_Fence handle = ((CCCP_Fence)generation << 32) | (CCCP_Fence)(index + 1);
+    if (pool) {
+        CCCP_PrepareDispatch(&fence->dispatch, &fence->uniforms, view, shader, userdata);
+        fence->dispatch.remaining = &fence->remaining;
+        // Jobs that did get submitted still signal the fence, the tiles left
+        // over are shaded here and drop the count held during setup
+        if (!CCCP_SubmitDispatch(pool, &fence->dispatch, shader->thread_count, false)) {
+            CCCP_ShaderWorker(&fence->dispatch);
+            return handle;
+        }
+    } else
+        // Outside of cccp there's no pool to run on, the fence is signaled on return
+        CCCP_ApplyShaderView(view, shader, userdata);
+    atomic_fetch_sub(&fence->remaining, 1);
+    return handle;
+}
+
+bool CCCP_FenceDone(CCCP_Fence fence) {
+    unsigned int index = (unsigned int)(fence & 0xFFFFFFFF);
+    if (!index || index > MAX_FENCES)
+        return true;
+    ShaderFence *slot = &fences[index - 1];
+    unsigned int generation = (unsigned int)(fence >> 32);
+    if (atomic_load(&slot->generation) != generation)
+        return true;
+    return atomic_load(&slot->remaining) == 0 || atomic_load(&slot->generation) != generation;
+}
+
+// Runs queued tiles on this thread too, without waiting on every other
+// job like draining the whole pool would
+static void CCCP_HelpFences(void) {
+    CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+    if (!pool || !CCCP_ThreadPoolHelp(pool))
+        thrd_yield();
+}
+
+void CCCP_WaitFence(CCCP_Fence fence) {
+    while (!CCCP_FenceDone(fence))
+        CCCP_HelpFences();
+}
+
+void CCCP_WaitAllFences(void) {
+    // Claimed slots count down to 0 once their dispatch is done
+    for (int i = 0; i < MAX_FENCES; i++)
+        while (atomic_load(&fences[i].remaining) > 0)
+            CCCP_HelpFences();
+}
+
+typedef struct {
+    CCCP_Shader shader;
+    CCCP_PassInput inputs[CCCP_MAX_PASS_INPUTS];
+    int input_count;
+    int level; // Passes on the same level don't depend on each other
+    CCCP_Surface outputs[2];
+    CCCP_ShaderPass data;
+} ShaderGraphPass;
+
+struct CCCP_ShaderGraph {
+    ShaderGraphPass *passes;
+    int pass_count, pass_capacity;
+    int level_count;
+    int current; // Which of each pass's outputs is this frame's
+    unsigned int width, height;
+};
+
+CCCP_ShaderGraph* CCCP_NewShaderGraph(unsigned int width, unsigned int height) {
+    if (!width || !height)
+        return NULL;
+    CCCP_ShaderGraph *graph = malloc(sizeof(CCCP_ShaderGraph));
+    if (!graph)
+        return NULL;
+    memset(graph, 0, sizeof(CCCP_ShaderGraph));
+    graph->width = width;
+    graph->height = height;
+    return graph;
+}
+
+static void CCCP_DestroyPassOutputs(ShaderGraphPass *pass) {
+    for (int i = 0; i < 2; i++)
+        if (pass->outputs[i]) {
+            CCCP_DestroySurface(pass->outputs[i]);
+            pass->outputs[i] = NULL;
+        }
+}
+
+static bool CCCP_NewPassOutputs(ShaderGraphPass *pass, unsigned int width, unsigned int height) {
+    for (int i = 0; i < 2; i++)
+        if (!(pass->outputs[i] = CCCP_NewSurface(width, height, rgba(0, 0, 0, 0)))) {
+            CCCP_DestroyPassOutputs(pass);
+            return false;
+        }
+    return true;
+}
+
+void CCCP_DestroyShaderGraph(CCCP_ShaderGraph *graph) {
+    if (!graph)
+        return;
+    for (int i = 0; i < graph->pass_count; i++)
+        CCCP_DestroyPassOutputs(&graph->passes[i]);
+    if (graph->passes)
+        free(graph->passes);
+    free(graph);
+}
+
+int CCCP_AddShaderPass(CCCP_ShaderGraph *graph, CCCP_Shader *shader, const CCCP_PassInput *inputs, int input_count, void *userdata) {
+    if (!graph || !shader || input_count < 0 || input_count > CCCP_MAX_PASS_INPUTS || (input_count && !inputs))
+        return -1;
+    int index = graph->pass_count;
+    int level = 0;
+    for (int i = 0; i < input_count; i++) {
+        int source = inputs[i].pass;
+        // Reading this frame's output needs the source to already be in the graph,
+        // which also keeps the graph acyclic
+        if (source < 0 || source > index || (!inputs[i].previous && source == index))
+            return -1;
+        if (!inputs[i].previous && graph->passes[source].level + 1 > level)
+            level = graph->passes[source].level + 1;
+    }
+    if (graph->pass_count == graph->pass_capacity) {
+        int capacity = graph->pass_capacity ? graph->pass_capacity * 2 : 4;
+        ShaderGraphPass *passes = realloc(graph->passes, capacity * sizeof(ShaderGraphPass));
+        if (!passes)
+            return -1;
+        graph->passes = passes;
+        graph->pass_capacity = capacity;
+    }
+    ShaderGraphPass *pass = &graph->passes[index];
+    memset(pass, 0, sizeof(ShaderGraphPass));
+    if (!CCCP_NewPassOutputs(pass, graph->width, graph->height))
+        return -1;
+    pass->shader = *shader;
+    if (input_count)
+        memcpy(pass->inputs, inputs, input_count * sizeof(CCCP_PassInput));
+    pass->input_count = input_count;
+    pass->level = level;
+    pass->data.userdata = userdata;
+    if (level + 1 > graph->level_count)
+        graph->level_count = level + 1;
+    graph->pass_count++;
+    return index;
+}
+
+bool CCCP_RunShaderGraph(CCCP_ShaderGraph *graph) {
+    if (!graph)
+        return false;
+    // Swap by index, last frame's outputs become this frame's previous
+    int current = graph->current ^ 1;
+    int previous = graph->current;
+    for (int i = 0; i < graph->pass_count; i++) {
+        ShaderGraphPass *pass = &graph->passes[i];
+        pass->data.previous = pass->outputs[previous];
+        pass->data.input_count = pass->input_count;
+        for (int j = 0; j < pass->input_count; j++)
+            pass->data.inputs[j] = graph->passes[pass->inputs[j].pass].outputs[pass->inputs[j].previous ? previous : current];
+    }
+    bool result = true;
+    CCCP_Fence level_fences[MAX_FENCES];
+    for (int level = 0; level < graph->level_count; level++) {
+        int fence_count = 0;
+        for (int i = 0; i < graph->pass_count; i++) {
+            ShaderGraphPass *pass = &graph->passes[i];
+            if (pass->level != level)
+                continue;
+            if (fence_count == MAX_FENCES) {
+                for (int j = 0; j < fence_count; j++)
+                    CCCP_WaitFence(level_fences[j]);
+                fence_count = 0;
+            }
+            if (!(level_fences[fence_count++] = CCCP_ApplyShaderAsync(pass->outputs[current], &pass->shader, &pass->data)))
+                result = false;
+        }
+        for (int j = 0; j < fence_count; j++)
+            CCCP_WaitFence(level_fences[j]);
+    }
+    graph->current = current;
     return result;
-}
\ No newline at end of file
+}
+
+CCCP_Surface CCCP_ShaderGraphOutput(CCCP_ShaderGraph *graph, int pass) {
+    if (!graph || pass < 0 || pass >= graph->pass_count)
+        return NULL;
+    return graph->passes[pass].outputs[graph->current];
+}
+
+bool CCCP_ResizeShaderGraph(CCCP_ShaderGraph *graph, unsigned int width, unsigned int height) {
+    if (!graph || !width || !height)
+        return false;
+    if (graph->width == width && graph->height == height)
+        return true;
+    if (!graph->pass_count) {
+        graph->width = width;
+        graph->height = height;
+        return true;
+    }
+    // Every new output is made before any old one goes, so a failure
+    // leaves the graph exactly as it was
+    int count = graph->pass_count * 2;
+    CCCP_Surface *outputs = calloc(count, sizeof(CCCP_Surface));
+    if (!outputs)
+        return false;
+    int made = 0;
+    while (made < count && (outputs[made] = CCCP_NewSurface(width, height, rgba(0, 0, 0, 0))))
+        made++;
+    if (made < count) {
+        for (int i = 0; i < made; i++)
+            CCCP_DestroySurface(outputs[i]);
+        free(outputs);
+        return false;
+    }
+    for (int i = 0; i < graph->pass_count; i++) {
+        CCCP_DestroyPassOutputs(&graph->passes[i]);
+        graph->passes[i].outputs[0] = outputs[i * 2];
+        graph->passes[i].outputs[1] = outputs[i * 2 + 1];
+    }
+    free(outputs);
+    graph->width = width;
+    graph->height = height;
+    return true;
+}
+
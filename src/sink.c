@@ -0,0 +1,428 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cccp.h"
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#if defined(PLATFORM_WINDOWS)
+#include <io.h>
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define MAX_FRAME_SINKS 16
+
+static CCCP_FrameSink* CCCP_OpenNullSink(const char *target, unsigned int width, unsigned int height, double fps);
+static CCCP_FrameSink* CCCP_OpenQoiSink(const char *target, unsigned int width, unsigned int height, double fps);
+static CCCP_FrameSink* CCCP_OpenPngSink(const char *target, unsigned int width, unsigned int height, double fps);
+static CCCP_FrameSink* CCCP_OpenGifSink(const char *target, unsigned int width, unsigned int height, double fps);
+static CCCP_FrameSink* CCCP_OpenRgbaSink(const char *target, unsigned int width, unsigned int height, double fps);
+static CCCP_FrameSink* CCCP_OpenY4mSink(const char *target, unsigned int width, unsigned int height, double fps);
+
+static struct {
+    const char *name;
+    CCCP_FrameSinkOpener open;
+} sinks[MAX_FRAME_SINKS] = {
+    {"null", CCCP_OpenNullSink},
+    {"qoi", CCCP_OpenQoiSink},
+    {"png", CCCP_OpenPngSink},
+    {"gif", CCCP_OpenGifSink},
+    {"rgba", CCCP_OpenRgbaSink},
+    {"y4m", CCCP_OpenY4mSink}
+};
+
+static bool CCCP_NullSinkWrite(CCCP_FrameSink *sink, CCCP_Surface frame, uint64_t index) {
+    return true;
+}
+
+static void CCCP_NullSinkClose(CCCP_FrameSink *sink, const CCCP_RunStats *stats) {
+    if (stats && stats->frames)
+        printf("frames: %llu in %.2fs (%.1f fps), scene time: %.2fs, frame p50: %.2fms, p99: %.2fms, worst: %.2fms\n",
+               (unsigned long long)stats->frames,
+               stats->wallTime,
+               stats->wallTime > 0 ? stats->frames / stats->wallTime : 0.0,
+               stats->sceneTime,
+               stats->timing.p50 * 1000.0,
+               stats->timing.p99 * 1000.0,
+               stats->timing.worst * 1000.0);
+    free(sink);
+}
+
+static CCCP_FrameSink* CCCP_OpenNullSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    CCCP_FrameSink *sink = malloc(sizeof(CCCP_FrameSink));
+    if (!sink)
+        return NULL;
+    sink->write = CCCP_NullSinkWrite;
+    sink->close = CCCP_NullSinkClose;
+    sink->userdata = NULL;
+    return sink;
+}
+
+// The runtime already hands every frame to the recorder, these sinks only
+// switch it on for the run and make it wait on the encoders
+static void CCCP_RecordSinkClose(CCCP_FrameSink *sink, const CCCP_RunStats *stats) {
+    CCCP_StopRecording();
+    uint64_t written = 0, dropped = 0;
+    if (!CCCP_GetRecordingStats(&written, &dropped))
+        fprintf(stderr, "ERROR: Failed to write some recorded frames\n");
+    printf("recorded: %llu frames, dropped: %llu\n", (unsigned long long)written, (unsigned long long)dropped);
+    CCCP_NullSinkClose(sink, stats);
+}
+
+static CCCP_FrameSink* CCCP_OpenRecordSink(const char *target, CCCP_RecordFormat format) {
+    if (!target || !*target)
+        return NULL;
+    CCCP_FrameSink *sink = malloc(sizeof(CCCP_FrameSink));
+    if (!sink)
+        return NULL;
+    CCCP_SetRecordingBackpressure(RECORD_BLOCK);
+    if (!CCCP_StartRecording(target, format)) {
+        free(sink);
+        return NULL;
+    }
+    sink->write = CCCP_NullSinkWrite;
+    sink->close = CCCP_RecordSinkClose;
+    sink->userdata = NULL;
+    return sink;
+}
+
+static CCCP_FrameSink* CCCP_OpenQoiSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    return CCCP_OpenRecordSink(target, RECORD_QOI);
+}
+
+static CCCP_FrameSink* CCCP_OpenPngSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    return CCCP_OpenRecordSink(target, RECORD_PNG);
+}
+
+static CCCP_FrameSink* CCCP_OpenGifSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    return CCCP_OpenRecordSink(target, RECORD_GIF);
+}
+
+// Raw frames for an external encoder. The render thread converts each frame
+// into one half of a double buffer while the writer thread drains the other
+typedef struct {
+    int fd;
+    bool y4m;
+    unsigned int width, height;
+    size_t frame_size;
+    uint8_t *buffers[2];
+    bool filled[2];
+    int next;
+    bool closing, failed;
+    thrd_t thread;
+    mtx_t lock;
+    cnd_t changed;
+} StreamSink;
+
+// Every byte of the vectors ends up written, short writes resume mid vector
+static bool CCCP_WriteAll(int fd, struct iovec *iov, int count) {
+    while (count) {
+#if defined(PLATFORM_WINDOWS)
+        long written = _write(fd, iov->iov_base, (unsigned int)iov->iov_len);
+#else
+        ssize_t written = writev(fd, iov, count);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        while (count && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+static int CCCP_StreamWriter(void *arg) {
+    StreamSink *stream = (StreamSink*)arg;
+    int current = 0;
+    mtx_lock(&stream->lock);
+    for (;;) {
+        if (!stream->filled[current]) {
+            if (stream->closing)
+                break;
+            cnd_wait(&stream->changed, &stream->lock);
+            continue;
+        }
+        mtx_unlock(&stream->lock);
+        struct iovec iov[2] = {
+            { "FRAME\n", 6 },
+            { stream->buffers[current], stream->frame_size }
+        };
+        bool result = stream->y4m ? CCCP_WriteAll(stream->fd, iov, 2) : CCCP_WriteAll(stream->fd, iov + 1, 1);
+        mtx_lock(&stream->lock);
+        if (!result)
+            stream->failed = true;
+        stream->filled[current] = false;
+        current ^= 1;
+        cnd_broadcast(&stream->changed);
+    }
+    mtx_unlock(&stream->lock);
+    return 0;
+}
+
+// Full range BT.601 in 8.8 fixed point, as expected by C420jpeg
+static inline int CCCP_Luma(int r, int g, int b) {
+    return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+// Saturated blue and red round up to 256 on their chroma axis, clamp
+// branchlessly like the shader packing does
+static inline int CCCP_ClampByte(int i) {
+    i &= ~(i >> 31);
+    return (i | ((255 - i) >> 31)) & 255;
+}
+
+static inline ivec4 CCCP_ClampBytes4(ivec4 i) {
+    i &= ~(i >> 31);
+    return (i | ((255 - i) >> 31)) & 255;
+}
+
+static inline int CCCP_ChromaU(int r, int g, int b) {
+    return CCCP_ClampByte(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+}
+
+static inline int CCCP_ChromaV(int r, int g, int b) {
+    return CCCP_ClampByte(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+}
+
+// Each 2x2 block shares the average of its chroma, the edge pixel stands in
+// for the missing half of a block on odd sizes
+static void CCCP_ConvertYUV420(const color_t *src, int w, int h, uint8_t *y, uint8_t *u, uint8_t *v) {
+    int cw = (w + 1) / 2;
+    for (int row = 0; row < h; row += 2) {
+        const color_t *a = src + row * w;
+        const color_t *b = row + 1 < h ? a + w : a;
+        uint8_t *ya = y + row * w, *yb = row + 1 < h ? ya + w : NULL;
+        uint8_t *ur = u + (row / 2) * cw, *vr = v + (row / 2) * cw;
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            uvec8 pa, pb;
+            memcpy(&pa, a + x, sizeof(pa));
+            memcpy(&pb, b + x, sizeof(pb));
+            ivec8 ra = (ivec8)(pa & 255), ga = (ivec8)(pa >> 8 & 255), ba = (ivec8)(pa >> 16 & 255);
+            ivec8 rb = (ivec8)(pb & 255), gb = (ivec8)(pb >> 8 & 255), bb = (ivec8)(pb >> 16 & 255);
+            ivec8 la = (77 * ra + 150 * ga + 29 * ba + 128) >> 8;
+            ivec8 lb = (77 * rb + 150 * gb + 29 * bb + 128) >> 8;
+            for (int i = 0; i < 8; i++)
+                ya[x + i] = la[i];
+            if (yb)
+                for (int i = 0; i < 8; i++)
+                    yb[x + i] = lb[i];
+            ivec8 rs = ra + rb, gs = ga + gb, bs = ba + bb;
+            ivec4 r = (__builtin_shufflevector(rs, rs, 0, 2, 4, 6) + __builtin_shufflevector(rs, rs, 1, 3, 5, 7) + 2) >> 2;
+            ivec4 g = (__builtin_shufflevector(gs, gs, 0, 2, 4, 6) + __builtin_shufflevector(gs, gs, 1, 3, 5, 7) + 2) >> 2;
+            ivec4 bl = (__builtin_shufflevector(bs, bs, 0, 2, 4, 6) + __builtin_shufflevector(bs, bs, 1, 3, 5, 7) + 2) >> 2;
+            ivec4 cu = CCCP_ClampBytes4(((-43 * r - 85 * g + 128 * bl + 128) >> 8) + 128);
+            ivec4 cv = CCCP_ClampBytes4(((128 * r - 107 * g - 21 * bl + 128) >> 8) + 128);
+            for (int i = 0; i < 4; i++) {
+                ur[x / 2 + i] = cu[i];
+                vr[x / 2 + i] = cv[i];
+            }
+        }
+        for (; x < w; x += 2) {
+            int x1 = x + 1 < w ? x + 1 : x;
+            ya[x] = CCCP_Luma(a[x].r, a[x].g, a[x].b);
+            if (x1 != x)
+                ya[x1] = CCCP_Luma(a[x1].r, a[x1].g, a[x1].b);
+            if (yb) {
+                yb[x] = CCCP_Luma(b[x].r, b[x].g, b[x].b);
+                if (x1 != x)
+                    yb[x1] = CCCP_Luma(b[x1].r, b[x1].g, b[x1].b);
+            }
+            int r = (a[x].r + a[x1].r + b[x].r + b[x1].r + 2) >> 2;
+            int g = (a[x].g + a[x1].g + b[x].g + b[x1].g + 2) >> 2;
+            int bl = (a[x].b + a[x1].b + b[x].b + b[x1].b + 2) >> 2;
+            ur[x / 2] = CCCP_ChromaU(r, g, bl);
+            vr[x / 2] = CCCP_ChromaV(r, g, bl);
+        }
+    }
+}
+
+static bool CCCP_StreamSinkWrite(CCCP_FrameSink *sink, CCCP_Surface frame, uint64_t index) {
+    StreamSink *stream = (StreamSink*)sink->userdata;
+    int w = CCCP_SurfaceWidth(frame), h = CCCP_SurfaceHeight(frame);
+    if (w != stream->width || h != stream->height)
+        return false;
+    // Nothing is dropped, the renderer waits if the encoder falls behind
+    mtx_lock(&stream->lock);
+    while (stream->filled[stream->next] && !stream->failed)
+        cnd_wait(&stream->changed, &stream->lock);
+    bool failed = stream->failed;
+    mtx_unlock(&stream->lock);
+    if (failed)
+        return false;
+    uint8_t *buffer = stream->buffers[stream->next];
+    if (stream->y4m)
+        CCCP_ConvertYUV420(frame, w, h, buffer, buffer + w * h, buffer + w * h + ((w + 1) / 2) * ((h + 1) / 2));
+    else
+        memcpy(buffer, frame, stream->frame_size);
+    mtx_lock(&stream->lock);
+    stream->filled[stream->next] = true;
+    cnd_broadcast(&stream->changed);
+    mtx_unlock(&stream->lock);
+    stream->next ^= 1;
+    return true;
+}
+
+static void CCCP_DestroyStream(StreamSink *stream) {
+    if (stream->fd > 2)
+        close(stream->fd);
+    for (int i = 0; i < 2; i++)
+        if (stream->buffers[i])
+            free(stream->buffers[i]);
+    free(stream);
+}
+
+static void CCCP_StreamSinkClose(CCCP_FrameSink *sink, const CCCP_RunStats *stats) {
+    StreamSink *stream = (StreamSink*)sink->userdata;
+    mtx_lock(&stream->lock);
+    stream->closing = true;
+    cnd_broadcast(&stream->changed);
+    mtx_unlock(&stream->lock);
+    thrd_join(stream->thread, NULL);
+    if (stream->failed)
+        fprintf(stderr, "ERROR: Failed to write to the frame stream\n");
+    if (stats && stats->frames)
+        fprintf(stderr, "streamed: %llu frames in %.2fs (%.1f fps, %.1f MB/s)\n",
+                (unsigned long long)stats->frames,
+                stats->wallTime,
+                stats->wallTime > 0 ? stats->frames / stats->wallTime : 0.0,
+                stats->wallTime > 0 ? stats->frames * (double)stream->frame_size / stats->wallTime / 1000000.0 : 0.0);
+    cnd_destroy(&stream->changed);
+    mtx_destroy(&stream->lock);
+    CCCP_DestroyStream(stream);
+    free(sink);
+}
+
+static CCCP_FrameSink* CCCP_OpenStreamSink(const char *target, unsigned int width, unsigned int height, double fps, bool y4m) {
+    CCCP_FrameSink *sink = malloc(sizeof(CCCP_FrameSink));
+    StreamSink *stream = calloc(1, sizeof(StreamSink));
+    if (!sink || !stream)
+        goto BAIL;
+    stream->fd = -1;
+    stream->y4m = y4m;
+    stream->width = width;
+    stream->height = height;
+    stream->frame_size = y4m ? width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2) : width * height * 4;
+    for (int i = 0; i < 2; i++)
+        if (!(stream->buffers[i] = malloc(stream->frame_size)))
+            goto BAIL;
+    if (!target || !*target || !strcmp(target, "-")) {
+#if defined(PLATFORM_WINDOWS)
+        stream->fd = _fileno(stdout);
+        _setmode(stream->fd, _O_BINARY);
+#else
+        stream->fd = STDOUT_FILENO;
+#endif
+    } else if ((stream->fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644)) < 0)
+        goto BAIL;
+#if !defined(PLATFORM_WINDOWS)
+    // A reader that goes away should end the run, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (y4m) {
+        char header[128];
+        // Whole rates stay whole, anything else keeps three decimals
+        int rate = fps == (int)fps ? 1 : 1000;
+        int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%d:%d Ip A1:1 C420jpeg\n",
+                              width, height, (int)(fps * rate + .5), rate);
+        struct iovec iov = { header, length };
+        if (!CCCP_WriteAll(stream->fd, &iov, 1))
+            goto BAIL;
+    }
+    if (mtx_init(&stream->lock, mtx_plain) != thrd_success)
+        goto BAIL;
+    if (cnd_init(&stream->changed) != thrd_success) {
+        mtx_destroy(&stream->lock);
+        goto BAIL;
+    }
+    if (thrd_create(&stream->thread, CCCP_StreamWriter, stream) != thrd_success) {
+        cnd_destroy(&stream->changed);
+        mtx_destroy(&stream->lock);
+        goto BAIL;
+    }
+    sink->write = CCCP_StreamSinkWrite;
+    sink->close = CCCP_StreamSinkClose;
+    sink->userdata = stream;
+    return sink;
+
+BAIL:
+    if (stream)
+        CCCP_DestroyStream(stream);
+    if (sink)
+        free(sink);
+    return NULL;
+}
+
+static CCCP_FrameSink* CCCP_OpenRgbaSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    return CCCP_OpenStreamSink(target, width, height, fps, false);
+}
+
+static CCCP_FrameSink* CCCP_OpenY4mSink(const char *target, unsigned int width, unsigned int height, double fps) {
+    return CCCP_OpenStreamSink(target, width, height, fps, true);
+}
+
+bool CCCP_RegisterFrameSink(const char *name, CCCP_FrameSinkOpener open) {
+    if (!name || !open)
+        return false;
+    for (int i = 0; i < MAX_FRAME_SINKS; i++) {
+        if (!sinks[i].name) {
+            sinks[i].name = name;
+            sinks[i].open = open;
+            return true;
+        }
+        if (!strcmp(sinks[i].name, name))
+            return false;
+    }
+    return false;
+}
+
+CCCP_FrameSink* CCCP_OpenFrameSink(const char *spec, unsigned int width, unsigned int height, double fps) {
+    if (!spec)
+        return NULL;
+    const char *colon = strchr(spec, ':');
+    size_t length = colon ? (size_t)(colon - spec) : strlen(spec);
+    for (int i = 0; i < MAX_FRAME_SINKS && sinks[i].name; i++)
+        if (strlen(sinks[i].name) == length && !strncmp(sinks[i].name, spec, length))
+            return sinks[i].open(colon ? colon + 1 : NULL, width, height, fps);
+    return NULL;
+}
+
+void CCCP_CloseFrameSink(CCCP_FrameSink *sink, const CCCP_RunStats *stats) {
+    if (sink && sink->close)
+        sink->close(sink, stats);
+}
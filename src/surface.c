@@ -25,12 +25,29 @@
 #define PAUL_RANDOM_IMPLEMENTATION
 #include "paul_random.h"
 
+#define MAX_BLEND_BANDS 64
+#define BLEND_PARALLEL_PIXELS (256 * 256)
+
 CCCP_Surface CCCP_NewSurface(unsigned int w, unsigned int h, color_t clearColor) {
     return bitmap_empty(w, h, clearColor);
 }
 
+// Only the surfaces handed straight back to the scene can come from the
+// frame arena, see CCCP_BeginFrameArena
+static CCCP_Surface CCCP_NewResultSurface(unsigned int w, unsigned int h, color_t clearColor) {
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface surface = CCCP_NewSurface(w, h, clearColor);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return surface;
+}
+
 CCCP_Surface CCCP_SurfaceFromMemory(const void* data, int width, int height, bitmap_format_t format) {
-    return bitmap_load(data, width, height, format);   
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface surface = bitmap_load(data, width, height, format);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return surface;
 }
 
 CCCP_Surface CCCP_SurfaceFromFile(const char* filename) {
@@ -51,7 +68,7 @@ CCCP_Surface CCCP_SurfaceFromFile(const char* filename) {
             return NULL;
     }
 
-    CCCP_Surface bmp = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 0.0f});
+    CCCP_Surface bmp = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 0.0f});
     if (!bmp)
         return NULL;
     for (int y = 0; y < height; y++)
@@ -69,70 +86,826 @@ CCCP_Surface CCCP_CopySurface(CCCP_Surface surface) {
 }
 
 void CCCP_DestroySurface(CCCP_Surface surface) {
+    CCCP_TrackDirtyRegions(surface, false);
     bitmap_destroy(surface);
 }
 
 int CCCP_SurfaceWidth(CCCP_Surface surface) {
-    return bitmap_width(surface);
+    return bitmap_width(surface) - bitmap_padding(surface);
 }
 
 int CCCP_SurfaceHeight(CCCP_Surface surface) {
     return bitmap_height(surface);
 }
 
+// One bit per tile, rows of tiles padded to whole words. Lives in the
+// bitmap header's user data so it follows the surface across modules
+typedef struct {
+    int tiles_x, tiles_y, words;
+    uint64_t bits[];
+} CCCP_DirtyTiles;
+
+bool CCCP_TrackDirtyRegions(CCCP_Surface surface, bool enable) {
+    if (!surface)
+        return false;
+    CCCP_DirtyTiles *tiles = bitmap_userdata(surface);
+    if (!enable) {
+        if (tiles)
+            free(tiles);
+        bitmap_set_userdata(surface, NULL);
+        return true;
+    }
+    if (tiles)
+        return true;
+    // Padding columns are never content, so never dirty
+    int tiles_x = (CCCP_SurfaceWidth(surface) + CCCP_DIRTY_TILE - 1) / CCCP_DIRTY_TILE;
+    int tiles_y = (bitmap_height(surface) + CCCP_DIRTY_TILE - 1) / CCCP_DIRTY_TILE;
+    int words = (tiles_x + 63) / 64;
+    if (!(tiles = calloc(1, sizeof(CCCP_DirtyTiles) + words * tiles_y * sizeof(uint64_t))))
+        return false;
+    tiles->tiles_x = tiles_x;
+    tiles->tiles_y = tiles_y;
+    tiles->words = words;
+    bitmap_set_userdata(surface, tiles);
+    // Nothing is known about what's already there
+    CCCP_MarkSurfaceDirty(surface);
+    return true;
+}
+
+void CCCP_MarkDirty(CCCP_Surface surface, int x, int y, int w, int h) {
+    CCCP_DirtyTiles *tiles = bitmap_userdata(surface);
+    if (!tiles)
+        return;
+    if (w < 0) {
+        x += w;
+        w = -w;
+    }
+    if (h < 0) {
+        y += h;
+        h = -h;
+    }
+    int sw = CCCP_SurfaceWidth(surface), sh = bitmap_height(surface);
+    int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    int x1 = x + w > sw ? sw : x + w, y1 = y + h > sh ? sh : y + h;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    int tx0 = x0 / CCCP_DIRTY_TILE, tx1 = (x1 - 1) / CCCP_DIRTY_TILE;
+    int ty0 = y0 / CCCP_DIRTY_TILE, ty1 = (y1 - 1) / CCCP_DIRTY_TILE;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        uint64_t *row = tiles->bits + ty * tiles->words;
+        for (int word = tx0 / 64; word <= tx1 / 64; word++) {
+            int first = word * 64 > tx0 ? 0 : tx0 - word * 64;
+            int last = word * 64 + 63 < tx1 ? 63 : tx1 - word * 64;
+            uint64_t mask = (~0ull >> (63 - last)) & (~0ull << first);
+            row[word] |= mask;
+        }
+    }
+}
+
+void CCCP_MarkSurfaceDirty(CCCP_Surface surface) {
+    CCCP_MarkDirty(surface, 0, 0, CCCP_SurfaceWidth(surface), bitmap_height(surface));
+}
+
+void CCCP_ClearDirty(CCCP_Surface surface) {
+    CCCP_DirtyTiles *tiles = bitmap_userdata(surface);
+    if (tiles)
+        memset(tiles->bits, 0, tiles->words * tiles->tiles_y * sizeof(uint64_t));
+}
+
+void CCCP_MergeDirty(CCCP_Surface dest, CCCP_Surface src) {
+    CCCP_DirtyTiles *to = bitmap_userdata(dest);
+    CCCP_DirtyTiles *from = bitmap_userdata(src);
+    if (!to)
+        return;
+    if (!from || to->tiles_x != from->tiles_x || to->tiles_y != from->tiles_y) {
+        // Untracked or differently sized, anything could have changed
+        if (src != dest)
+            CCCP_MarkSurfaceDirty(dest);
+        return;
+    }
+    for (int i = 0; i < to->words * to->tiles_y; i++)
+        to->bits[i] |= from->bits[i];
+}
+
+static inline bool CCCP_TileDirty(const CCCP_DirtyTiles *tiles, int tx, int ty) {
+    return (tiles->bits[ty * tiles->words + tx / 64] >> (tx % 64)) & 1;
+}
+
+int CCCP_GetDirtyRects(CCCP_Surface surface, CCCP_Rect *rects, int max) {
+    CCCP_DirtyTiles *tiles = bitmap_userdata(surface);
+    if (!tiles)
+        return -1;
+    if (!rects || max <= 0)
+        return 0;
+    int count = 0;
+    bool overflow = false;
+    int bx0 = tiles->tiles_x, by0 = tiles->tiles_y, bx1 = 0, by1 = 0;
+    // Built in tile units, converted to pixels at the end
+    for (int ty = 0; ty < tiles->tiles_y; ty++) {
+        int tx = 0;
+        while (tx < tiles->tiles_x) {
+            if (!CCCP_TileDirty(tiles, tx, ty)) {
+                tx++;
+                continue;
+            }
+            int start = tx;
+            while (tx < tiles->tiles_x && CCCP_TileDirty(tiles, tx, ty))
+                tx++;
+            bx0 = start < bx0 ? start : bx0;
+            bx1 = tx > bx1 ? tx : bx1;
+            by0 = ty < by0 ? ty : by0;
+            by1 = ty + 1;
+            if (overflow)
+                continue;
+            // Extend a run from the row above that spans the same tiles
+            int i;
+            for (i = count - 1; i >= 0; i--)
+                if (rects[i].y + rects[i].h == ty && rects[i].x == start && rects[i].w == tx - start)
+                    break;
+            if (i >= 0)
+                rects[i].h++;
+            else if (count < max)
+                rects[count++] = (CCCP_Rect){start, ty, tx - start, 1};
+            else
+                overflow = true;
+        }
+    }
+    if (overflow) {
+        rects[0] = (CCCP_Rect){bx0, by0, bx1 - bx0, by1 - by0};
+        count = 1;
+    }
+    int w = CCCP_SurfaceWidth(surface), h = bitmap_height(surface);
+    for (int i = 0; i < count; i++) {
+        CCCP_Rect *r = &rects[i];
+        r->x *= CCCP_DIRTY_TILE;
+        r->y *= CCCP_DIRTY_TILE;
+        r->w = r->x + r->w * CCCP_DIRTY_TILE > w ? w - r->x : r->w * CCCP_DIRTY_TILE;
+        r->h = r->y + r->h * CCCP_DIRTY_TILE > h ? h - r->y : r->h * CCCP_DIRTY_TILE;
+    }
+    return count;
+}
+
+// Rows of padded surfaces start aligned, so only unpadded ones pay for the
+// scalar head before the vector stores
+static void CCCP_FillPixels(color_t *dst, int count, color_t color) {
+    int i = 0;
+    for (; i < count && ((uintptr_t)(dst + i) & (sizeof(uvec8) - 1)); i++)
+        dst[i] = color;
+    uvec8 packet = (uvec8){0} + color.rgba;
+    for (; i + 8 <= count; i += 8)
+        *(uvec8*)(dst + i) = packet;
+    for (; i < count; i++)
+        dst[i] = color;
+}
+
 void CCCP_ClearSurface(CCCP_Surface surface, color_t clearColor) {
-    bitmap_fill(surface, clearColor);
+    CCCP_FillPixels(surface, bitmap_width(surface) * bitmap_height(surface), clearColor);
+    CCCP_MarkSurfaceDirty(surface);
 }
 
 bool CCCP_SetPixel(CCCP_Surface surface, int x, int y, color_t color) {
-    return bitmap_pset(surface, x, y, color);
+    return CCCP_ViewSetPixel(CCCP_SurfaceAsView(surface), x, y, color);
 }
 
 color_t CCCP_GetPixel(CCCP_Surface surface, int x, int y) {
     return bitmap_pget(surface, x, y);
 }
 
+CCCP_SurfaceView CCCP_ViewSurface(CCCP_Surface surface, int x, int y, int w, int h) {
+    int sw, sh;
+    if (!bitmap_size(surface, &sw, &sh))
+        return (CCCP_SurfaceView){0};
+    CCCP_SurfaceView whole = {
+        .surface = surface,
+        .pixels = surface,
+        .w = sw - bitmap_padding(surface),
+        .h = sh,
+        .stride = sw
+    };
+    return CCCP_SubView(whole, x, y, w, h);
+}
+
+CCCP_SurfaceView CCCP_SurfaceAsView(CCCP_Surface surface) {
+    return CCCP_ViewSurface(surface, 0, 0, CCCP_SurfaceWidth(surface), bitmap_height(surface));
+}
+
+CCCP_SurfaceView CCCP_NewPaddedSurface(unsigned int w, unsigned int h, color_t clearColor) {
+    unsigned int stride = (w + CCCP_SURFACE_ROW_PIXELS - 1) & ~(unsigned int)(CCCP_SURFACE_ROW_PIXELS - 1);
+    CCCP_Surface surface = CCCP_NewSurface(stride, h, clearColor);
+    // Already filled with clearColor, padding included
+    if (!surface)
+        return (CCCP_SurfaceView){0};
+    bitmap_set_padding(surface, stride - w);
+    return CCCP_ViewSurface(surface, 0, 0, w, h);
+}
+
+CCCP_SurfaceView CCCP_SubView(CCCP_SurfaceView view, int x, int y, int w, int h) {
+    int x0 = max(x, 0), y0 = max(y, 0);
+    int x1 = min(x + w, view.w), y1 = min(y + h, view.h);
+    // Empty views keep their surface but never touch a pixel
+    if (!view.pixels || x1 <= x0 || y1 <= y0)
+        return (CCCP_SurfaceView){ .surface = view.surface, .stride = view.stride };
+    return (CCCP_SurfaceView){
+        .surface = view.surface,
+        .pixels = view.pixels + y0 * view.stride + x0,
+        .x = view.x + x0,
+        .y = view.y + y0,
+        .w = x1 - x0,
+        .h = y1 - y0,
+        .stride = view.stride
+    };
+}
+
+// Dirty tracking lives on the surface, view coordinates are clipped to the
+// view and moved onto it
+static void CCCP_MarkViewDirty(const CCCP_SurfaceView *view, int x, int y, int w, int h) {
+    int x0 = max(x, 0), y0 = max(y, 0);
+    int x1 = min(x + w, view->w), y1 = min(y + h, view->h);
+    if (x1 > x0 && y1 > y0)
+        CCCP_MarkDirty(view->surface, view->x + x0, view->y + y0, x1 - x0, y1 - y0);
+}
+
+static inline void CCCP_ViewPut(const CCCP_SurfaceView *view, int x, int y, color_t color) {
+    if ((unsigned int)x < (unsigned int)view->w && (unsigned int)y < (unsigned int)view->h)
+        view->pixels[y * view->stride + x] = color;
+}
+
+// Inclusive horizontal run, the ends can come in either order
+static void CCCP_ViewSpan(const CCCP_SurfaceView *view, int y, int x0, int x1, color_t color) {
+    if ((unsigned int)y >= (unsigned int)view->h)
+        return;
+    if (x1 < x0) {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
+    }
+    x0 = max(x0, 0);
+    x1 = min(x1, view->w - 1);
+    if (x0 > x1)
+        return;
+    int count = x1 - x0 + 1;
+    // Spans that reach the edge of a padded surface run on into the padding
+    // up to a whole packet, so they end without a scalar tail
+    int padding = bitmap_padding(view->surface);
+    if (padding && view->x + x1 + 1 == CCCP_SurfaceWidth(view->surface))
+        count = min(count + padding, (count + 7) & ~7);
+    CCCP_FillPixels(view->pixels + y * view->stride + x0, count, color);
+}
+
+void CCCP_ClearView(CCCP_SurfaceView view, color_t color) {
+    if (!view.pixels)
+        return;
+    for (int y = 0; y < view.h; y++)
+        CCCP_ViewSpan(&view, y, 0, view.w - 1, color);
+    CCCP_MarkViewDirty(&view, 0, 0, view.w, view.h);
+}
+
+bool CCCP_ViewSetPixel(CCCP_SurfaceView view, int x, int y, color_t color) {
+    if (!view.pixels || (unsigned int)x >= (unsigned int)view.w || (unsigned int)y >= (unsigned int)view.h)
+        return false;
+    view.pixels[y * view.stride + x] = color;
+    CCCP_MarkDirty(view.surface, view.x + x, view.y + y, 1, 1);
+    return true;
+}
+
+color_t CCCP_ViewGetPixel(CCCP_SurfaceView view, int x, int y) {
+    if (!view.pixels || (unsigned int)x >= (unsigned int)view.w || (unsigned int)y >= (unsigned int)view.h)
+        return rgb(0, 0, 0);
+    return view.pixels[y * view.stride + x];
+}
+
+// Clips a blit against both views once, so the copy loops below never
+// have to check a single pixel. False if nothing is left to draw
+static bool CCCP_ClipBlit(const CCCP_SurfaceView *dest, const CCCP_SurfaceView *src, int *sx, int *sy, int *w, int *h, int *dx, int *dy) {
+    if (!dest->pixels || !src->pixels || *w <= 0 || *h <= 0)
+        return false;
+    int sw = src->w, sh = src->h, dw = dest->w, dh = dest->h;
+    // Trim the left/top edges against each surface, shifting the other side by the same amount
+    int left = max(max(-*sx, -*dx), 0), top = max(max(-*sy, -*dy), 0);
+    *sx += left;
+    *dx += left;
+    *w -= left;
+    *sy += top;
+    *dy += top;
+    *h -= top;
+    *w = min(*w, min(sw - *sx, dw - *dx));
+    *h = min(*h, min(sh - *sy, dh - *dy));
+    return *w > 0 && *h > 0;
+}
+
+static void CCCP_CopyRegion(CCCP_SurfaceView dest, CCCP_SurfaceView src, int sx, int sy, int w, int h, int dx, int dy) {
+    if (!CCCP_ClipBlit(&dest, &src, &sx, &sy, &w, &h, &dx, &dy))
+        return;
+    color_t *d = dest.pixels + dy * dest.stride + dx;
+    const color_t *s = src.pixels + sy * src.stride + sx;
+    // Views of the same surface can overlap, rows have to be copied in an
+    // order that never reads one that was already overwritten
+    if (dest.surface == src.surface && d > s) {
+        for (int row = h - 1; row >= 0; row--)
+            memmove(d + row * dest.stride, s + row * src.stride, w * sizeof(color_t));
+    } else if (dest.surface == src.surface) {
+        for (int row = 0; row < h; row++)
+            memmove(d + row * dest.stride, s + row * src.stride, w * sizeof(color_t));
+    } else {
+        for (int row = 0; row < h; row++)
+            memcpy(d + row * dest.stride, s + row * src.stride, w * sizeof(color_t));
+    }
+    CCCP_MarkDirty(dest.surface, dest.x + dx, dest.y + dy, w, h);
+}
+
+// Blending reads the destination, a source that overlaps it could read back
+// what was just written
+static bool CCCP_BlitOverlaps(const CCCP_SurfaceView *dest, const CCCP_SurfaceView *src, int sx, int sy, int w, int h, int dx, int dy) {
+    if (dest->surface != src->surface)
+        return false;
+    int ax = dest->x + dx, ay = dest->y + dy, bx = src->x + sx, by = src->y + sy;
+    return ax < bx + w && bx < ax + w && ay < by + h && by < ay + h;
+}
+
+#define BLEND_STAGE_PIXELS 256
+
+typedef void(*CCCP_RowBlend)(color_t *dst, const color_t *src, int w, const void *userdata);
+
+// Overlapping regions are blended in the order memmove would copy them,
+// each piece of source is staged before its destination is written, so no
+// pixel is read after it's been blended over
+static void CCCP_BlendStaged(color_t *d, const color_t *s, int dstride, int sstride, int w, int h, CCCP_RowBlend blend, const void *userdata) {
+    color_t staged[BLEND_STAGE_PIXELS];
+    bool backwards = d > s;
+    for (int i = 0; i < h; i++) {
+        int row = backwards ? h - 1 - i : i;
+        for (int j = 0; j < w; j += BLEND_STAGE_PIXELS) {
+            int n = min(BLEND_STAGE_PIXELS, w - j);
+            int x = backwards ? w - j - n : j;
+            memcpy(staged, s + row * sstride + x, n * sizeof(color_t));
+            blend(d + row * dstride + x, staged, n, userdata);
+        }
+    }
+}
+
 void CCCP_BlitSurface(CCCP_Surface dest, CCCP_Surface src, int x, int y) {
-    bitmap_paste(dest, src, x, y);
+    CCCP_BlitSurfaceRect(dest, src, 0, 0, bitmap_width(src), bitmap_height(src), x, y);
 }
 
 void CCCP_BlitSurfaceRect(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY) {
-    bitmap_clipped_paste(dest, src, destX, destY, srcX, srcY, srcW, srcH);
+    CCCP_CopyRegion(CCCP_SurfaceAsView(dest), CCCP_SurfaceAsView(src), srcX, srcY, srcW, srcH, destX, destY);
+}
+
+void CCCP_BlitView(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y) {
+    CCCP_CopyRegion(dest, src, 0, 0, src.w, src.h, x, y);
+}
+
+// Scales two channels held in the low bytes of each 16-bit half by a / 255,
+// rounded exactly like a divide. Premultiplied source-over never overflows
+static inline uint32_t CCCP_ScaleChannels(uint32_t c, uint32_t a) {
+    uint32_t t = c * a + 0x00800080;
+    return ((t + ((t >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+static inline uvec8 CCCP_ScaleChannels8(uvec8 c, uvec8 a) {
+    uvec8 t = c * a + 0x00800080;
+    return ((t + ((t >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+static inline uint32_t CCCP_BlendPixel(uint32_t s, uint32_t d) {
+    uint32_t inv = 255 - (s >> 24);
+    return s + (CCCP_ScaleChannels(d & 0x00FF00FF, inv) | CCCP_ScaleChannels((d >> 8) & 0x00FF00FF, inv) << 8);
+}
+
+static void CCCP_BlendRow(color_t *dst, const color_t *src, int w) {
+    int x = 0;
+    // Eight pixels per step, wide enough for the compiler to use AVX2 and
+    // split into SSE2 pairs without it
+    for (; x + 8 <= w; x += 8) {
+        uvec8 s, d;
+        memcpy(&s, src + x, sizeof(s));
+        // Fully transparent spans are common in sprites, leave them alone
+        if (!(s[0] | s[1] | s[2] | s[3] | s[4] | s[5] | s[6] | s[7]))
+            continue;
+        memcpy(&d, dst + x, sizeof(d));
+        uvec8 inv = 255 - (s >> 24);
+        d = s + (CCCP_ScaleChannels8(d & 0x00FF00FF, inv) | CCCP_ScaleChannels8((d >> 8) & 0x00FF00FF, inv) << 8);
+        memcpy(dst + x, &d, sizeof(d));
+    }
+    for (; x < w; x++)
+        dst[x].rgba = CCCP_BlendPixel(src[x].rgba, dst[x].rgba);
+}
+
+void CCCP_BlitSurfaceBlend(CCCP_Surface dest, CCCP_Surface src, int x, int y) {
+    CCCP_BlitSurfaceRectBlend(dest, src, 0, 0, bitmap_width(src), bitmap_height(src), x, y);
+}
+
+static void CCCP_BlendRowStaged(color_t *dst, const color_t *src, int w, const void *userdata) {
+    (void)userdata;
+    CCCP_BlendRow(dst, src, w);
+}
+
+static void CCCP_BlendRegion(CCCP_SurfaceView dest, CCCP_SurfaceView src, int sx, int sy, int w, int h, int dx, int dy) {
+    if (!CCCP_ClipBlit(&dest, &src, &sx, &sy, &w, &h, &dx, &dy))
+        return;
+    color_t *d = dest.pixels + dy * dest.stride + dx;
+    const color_t *s = src.pixels + sy * src.stride + sx;
+    if (CCCP_BlitOverlaps(&dest, &src, sx, sy, w, h, dx, dy))
+        CCCP_BlendStaged(d, s, dest.stride, src.stride, w, h, CCCP_BlendRowStaged, NULL);
+    else
+        for (int row = 0; row < h; row++)
+            CCCP_BlendRow(d + row * dest.stride, s + row * src.stride, w);
+    CCCP_MarkDirty(dest.surface, dest.x + dx, dest.y + dy, w, h);
+}
+
+void CCCP_BlitSurfaceRectBlend(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY) {
+    CCCP_BlendRegion(CCCP_SurfaceAsView(dest), CCCP_SurfaceAsView(src), srcX, srcY, srcW, srcH, destX, destY);
+}
+
+void CCCP_BlitViewBlend(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y) {
+    CCCP_BlendRegion(dest, src, 0, 0, src.w, src.h, x, y);
+}
+
+void CCCP_PremultiplySurface(CCCP_Surface surface) {
+    int w, h;
+    if (!bitmap_size(surface, &w, &h))
+        return;
+    for (int i = 0; i < w * h; i++) {
+        uint32_t p = surface[i].rgba, a = p >> 24;
+        surface[i].rgba = (p & 0xFF000000) | CCCP_ScaleChannels(p & 0x00FF00FF, a) | CCCP_ScaleChannels((p >> 8) & 0xFF, a) << 8;
+    }
+    CCCP_MarkSurfaceDirty(surface);
+}
+
+// Exact x / 255 for anything up to 255 * 255 * 2
+static inline ivec8 CCCP_Div255(ivec8 x) {
+    return (ivec8)(((uvec8)x * 0x8081u) >> 23);
+}
+
+// Exact 2x / 255 for x up to 255 * 255, without overflowing the multiply
+static inline ivec8 CCCP_Div255x2(ivec8 x) {
+    ivec8 q = CCCP_Div255(x);
+    return q * 2 + (ivec8)(((x - q * 255) * 2 >= 255) & 1);
+}
+
+static inline ivec8 CCCP_Select(ivec8 mask, ivec8 a, ivec8 b) {
+    return (a & mask) | (b & ~mask);
+}
+
+// ceil(255 * 65536 / k), dodge and burn divide by multiplying with these
+#define RCP(K) (uint32_t)((255u * 65536u + (K) - 1) / (K))
+#define RCP4(K) RCP(K), RCP(K + 1), RCP(K + 2), RCP(K + 3)
+#define RCP16(K) RCP4(K), RCP4(K + 4), RCP4(K + 8), RCP4(K + 12)
+#define RCP64(K) RCP16(K), RCP16(K + 16), RCP16(K + 32), RCP16(K + 48)
+static const uint32_t blend_reciprocals[256] = {
+    0, RCP(1), RCP(2), RCP(3), RCP4(4), RCP4(8), RCP4(12), RCP16(16), RCP16(32), RCP16(48),
+    RCP64(64), RCP64(128), RCP64(192)
+};
+#undef RCP64
+#undef RCP16
+#undef RCP4
+#undef RCP
+
+// min(255, a * 255 / k), lanes where k is 0 come out as 0
+static inline ivec8 CCCP_DivideScaled(ivec8 a, ivec8 k) {
+    uvec8 r;
+    for (int i = 0; i < 8; i++)
+        r[i] = blend_reciprocals[k[i]];
+    ivec8 q = (ivec8)(((uvec8)a * r) >> 16);
+    return CCCP_Select(q > 255, (ivec8){0} + 255, q);
+}
+
+// Integer square root of values below 65536, a bit at a time in every lane
+static inline ivec8 CCCP_Sqrt(ivec8 x) {
+    ivec8 r = {0};
+    for (int bit = 128; bit; bit >>= 1) {
+        ivec8 t = r | bit;
+        r = CCCP_Select(t * t <= x, t, r);
+    }
+    return r;
+}
+
+// Each kernel blends one channel of eight pixels, a is the destination (base
+// layer) and b the source (blend layer). They follow paul_color's color_*
+// functions, integer only so they stay in vector registers
+#define BLEND_MODES                                                                     \
+    X(MULTIPLY, CCCP_Div255(a * b))                                                     \
+    X(SCREEN, 255 - CCCP_Div255((255 - a) * (255 - b)))                                 \
+    X(OVERLAY, CCCP_Select(a < 128, CCCP_Div255x2(a * b),                               \
+                           255 - CCCP_Div255x2((255 - a) * (255 - b))))                 \
+    X(SOFT_LIGHT, CCCP_Select(b < 128,                                                  \
+                              CCCP_Div255x2(a * b) + CCCP_Div255(CCCP_Div255(a * a) * (255 - 2 * b)), \
+                              CCCP_Div255x2(a * (255 - b)) + CCCP_Div255(CCCP_Sqrt(a * 255) * (2 * b - 255)))) \
+    X(HARD_LIGHT, CCCP_Select(b < 128, CCCP_Div255x2(a * b),                            \
+                              255 - CCCP_Div255x2((255 - a) * (255 - b))))              \
+    X(COLOR_DODGE, CCCP_Select(b == 255, (ivec8){0} + 255, CCCP_DivideScaled(a, 255 - b))) \
+    X(COLOR_BURN, 255 - CCCP_Select(b == 0, (ivec8){0} + 255, CCCP_DivideScaled(255 - a, b))) \
+    X(DARKEN, CCCP_Select(a < b, a, b))                                                 \
+    X(LIGHTEN, CCCP_Select(a > b, a, b))                                                \
+    X(DIFFERENCE, CCCP_Select(a > b, a - b, b - a))                                     \
+    X(EXCLUSION, a + b - CCCP_Div255x2(a * b))
+
+#define X(MODE, EXPR)                                                                   \
+    static inline ivec8 CCCP_Blend##MODE(ivec8 a, ivec8 b) {                            \
+        return EXPR;                                                                    \
+    }                                                                                   \
+    static void CCCP_BlendPacket##MODE(uvec8 *dst, uvec8 src) {                         \
+        uvec8 d = *dst;                                                                 \
+        ivec8 da = (ivec8)(d >> 24), sa = (ivec8)(src >> 24);                           \
+        uvec8 r = (uvec8)CCCP_Blend##MODE((ivec8)(d & 255), (ivec8)(src & 255));        \
+        uvec8 g = (uvec8)CCCP_Blend##MODE((ivec8)(d >> 8 & 255), (ivec8)(src >> 8 & 255)); \
+        uvec8 b = (uvec8)CCCP_Blend##MODE((ivec8)(d >> 16 & 255), (ivec8)(src >> 16 & 255)); \
+        uvec8 alpha = (uvec8)(255 - CCCP_Div255((255 - da) * (255 - sa)));              \
+        *dst = r | g << 8 | b << 16 | alpha << 24;                                      \
+    }
+BLEND_MODES
+#undef X
+
+// Straight alpha source-over. Opaque destinations, by far the common case,
+// reduce to a lerp, anything else needs a divide per pixel
+static void CCCP_BlendPacketALPHA(uvec8 *dst, uvec8 src) {
+    uvec8 d = *dst;
+    ivec8 sa = (ivec8)(src >> 24), inv = 255 - sa;
+    if ((d[0] & d[1] & d[2] & d[3] & d[4] & d[5] & d[6] & d[7]) >> 24 == 255) {
+        uvec8 r = (uvec8)CCCP_Div255((ivec8)(src & 255) * sa + (ivec8)(d & 255) * inv);
+        uvec8 g = (uvec8)CCCP_Div255((ivec8)(src >> 8 & 255) * sa + (ivec8)(d >> 8 & 255) * inv);
+        uvec8 b = (uvec8)CCCP_Div255((ivec8)(src >> 16 & 255) * sa + (ivec8)(d >> 16 & 255) * inv);
+        *dst = r | g << 8 | b << 16 | 0xFF000000;
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        int fa = src[i] >> 24, ba = d[i] >> 24;
+        // Output alpha scaled by 255, kept unrounded for the divide
+        int out = fa * 255 + ba * (255 - fa);
+        uint32_t result = 0;
+        if (out) {
+            for (int c = 0; c < 24; c += 8) {
+                int value = (int)((src[i] >> c & 255) * fa * 255 + (d[i] >> c & 255) * ba * (255 - fa)) / out;
+                result |= (uint32_t)min(value, 255) << c;
+            }
+            result |= (uint32_t)(out / 255) << 24;
+        }
+        (*dst)[i] = result;
+    }
+}
+
+typedef void(*CCCP_BlendPacket)(uvec8*, uvec8);
+
+static const CCCP_BlendPacket blend_packets[] = {
+    [BLEND_ALPHA] = CCCP_BlendPacketALPHA,
+#define X(MODE, _) [BLEND_##MODE] = CCCP_BlendPacket##MODE,
+    BLEND_MODES
+#undef X
+};
+
+static void CCCP_BlendModeRow(color_t *dst, const color_t *src, int w, CCCP_BlendPacket blend) {
+    uvec8 s, d;
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        memcpy(&s, src + x, sizeof(s));
+        memcpy(&d, dst + x, sizeof(d));
+        blend(&d, s);
+        memcpy(dst + x, &d, sizeof(d));
+    }
+    // The ragged end goes through the same kernel, padded out to a packet
+    if (x < w) {
+        s = d = (uvec8){0};
+        memcpy(&s, src + x, (w - x) * sizeof(color_t));
+        memcpy(&d, dst + x, (w - x) * sizeof(color_t));
+        blend(&d, s);
+        memcpy(dst + x, &d, (w - x) * sizeof(color_t));
+    }
+}
+
+static void CCCP_BlendModeRowStaged(color_t *dst, const color_t *src, int w, const void *userdata) {
+    CCCP_BlendModeRow(dst, src, w, *(const CCCP_BlendPacket*)userdata);
+}
+
+typedef struct {
+    color_t *dest;
+    const color_t *src;
+    int dest_stride, src_stride, w;
+    int first, last; // Rows of the clipped rectangle
+    CCCP_BlendPacket blend;
+    atomic_int *remaining; // Bands of this blit still running
+} BlendBand;
+
+static void CCCP_BlendBand(void *arg) {
+    BlendBand *band = (BlendBand*)arg;
+    for (int row = band->first; row < band->last; row++)
+        CCCP_BlendModeRow(band->dest + row * band->dest_stride, band->src + row * band->src_stride, band->w, band->blend);
+    if (band->remaining)
+        atomic_fetch_sub(band->remaining, 1);
+}
+
+static void CCCP_BlendModeRegion(CCCP_SurfaceView dest, CCCP_SurfaceView src, int srcX, int srcY, int srcW, int srcH, int destX, int destY, CCCP_BlendMode mode) {
+    if ((unsigned int)mode >= sizeof(blend_packets) / sizeof(blend_packets[0]))
+        return;
+    if (!CCCP_ClipBlit(&dest, &src, &srcX, &srcY, &srcW, &srcH, &destX, &destY))
+        return;
+    // Bands of an overlapping blit would race each other, it runs here in
+    // memmove order instead
+    if (CCCP_BlitOverlaps(&dest, &src, srcX, srcY, srcW, srcH, destX, destY)) {
+        CCCP_BlendStaged(dest.pixels + destY * dest.stride + destX, src.pixels + srcY * src.stride + srcX,
+                         dest.stride, src.stride, srcW, srcH, CCCP_BlendModeRowStaged, &blend_packets[mode]);
+        CCCP_MarkDirty(dest.surface, dest.x + destX, dest.y + destY, srcW, srcH);
+        return;
+    }
+    BlendBand bands[MAX_BLEND_BANDS];
+    BlendBand whole = {
+        .dest = dest.pixels + destY * dest.stride + destX,
+        .src = src.pixels + srcY * src.stride + srcX,
+        .dest_stride = dest.stride,
+        .src_stride = src.stride,
+        .w = srcW,
+        .first = 0,
+        .last = srcH,
+        .blend = blend_packets[mode],
+        .remaining = NULL
+    };
+    // Small blits aren't worth waking the pool for
+    CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+    int count = srcW * srcH < BLEND_PARALLEL_PIXELS ? 1 : min(min(CCCP_ThreadPoolSize(pool), MAX_BLEND_BANDS), srcH);
+    if (count <= 1)
+        CCCP_BlendBand(&whole);
+    else {
+        // Only this blit's bands are waited on, other work queued on the
+        // pool (async shaders, other threads' blits) keeps running
+        atomic_int remaining = count;
+        for (int i = 0; i < count; i++) {
+            bands[i] = whole;
+            bands[i].first = srcH * i / count;
+            bands[i].last = srcH * (i + 1) / count;
+            bands[i].remaining = &remaining;
+            // Whatever the pool won't take runs here
+            if (!CCCP_ThreadPoolSubmit(pool, CCCP_BlendBand, &bands[i]))
+                CCCP_BlendBand(&bands[i]);
+        }
+        CCCP_ThreadPoolWaitFor(pool, &remaining);
+    }
+    CCCP_MarkDirty(dest.surface, dest.x + destX, dest.y + destY, srcW, srcH);
+}
+
+void CCCP_BlitSurfaceMode(CCCP_Surface dest, CCCP_Surface src, int x, int y, CCCP_BlendMode mode) {
+    CCCP_BlitSurfaceRectMode(dest, src, 0, 0, bitmap_width(src), bitmap_height(src), x, y, mode);
+}
+
+void CCCP_BlitSurfaceRectMode(CCCP_Surface dest, CCCP_Surface src, int srcX, int srcY, int srcW, int srcH, int destX, int destY, CCCP_BlendMode mode) {
+    CCCP_BlendModeRegion(CCCP_SurfaceAsView(dest), CCCP_SurfaceAsView(src), srcX, srcY, srcW, srcH, destX, destY, mode);
+}
+
+void CCCP_BlitViewMode(CCCP_SurfaceView dest, CCCP_SurfaceView src, int x, int y, CCCP_BlendMode mode) {
+    CCCP_BlendModeRegion(dest, src, 0, 0, src.w, src.h, x, y, mode);
+}
+
+// The shapes clip pixel by pixel against the view, so they can start or end
+// anywhere, even well outside of it
+void CCCP_ViewDrawLine(CCCP_SurfaceView view, int x1, int y1, int x2, int y2, color_t color) {
+    if (!view.pixels)
+        return;
+    if (y1 == y2)
+        CCCP_ViewSpan(&view, y1, x1, x2, color);
+    else {
+        int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+        int dy = abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+        int err = (dx > dy ? dx : -dy) / 2;
+        for (int x = x1, y = y1;;) {
+            CCCP_ViewPut(&view, x, y, color);
+            if (x == x2 && y == y2)
+                break;
+            int e2 = err;
+            if (e2 > -dx) {
+                err -= dy;
+                x += sx;
+            }
+            if (e2 < dy) {
+                err += dx;
+                y += sy;
+            }
+        }
+    }
+    CCCP_MarkViewDirty(&view, min(x1, x2), min(y1, y2), abs(x2 - x1) + 1, abs(y2 - y1) + 1);
+}
+
+void CCCP_ViewDrawRect(CCCP_SurfaceView view, int x, int y, int w, int h, color_t color, bool filled) {
+    if (!view.pixels || w <= 0 || h <= 0)
+        return;
+    if (filled)
+        for (int row = max(y, 0); row < min(y + h, view.h); row++)
+            CCCP_ViewSpan(&view, row, x, x + w - 1, color);
+    else {
+        CCCP_ViewSpan(&view, y, x, x + w - 1, color);
+        CCCP_ViewSpan(&view, y + h - 1, x, x + w - 1, color);
+        for (int row = max(y + 1, 0); row < min(y + h - 1, view.h); row++) {
+            CCCP_ViewPut(&view, x, row, color);
+            CCCP_ViewPut(&view, x + w - 1, row, color);
+        }
+    }
+    CCCP_MarkViewDirty(&view, x, y, w, h);
+}
+
+void CCCP_ViewDrawCircle(CCCP_SurfaceView view, int xc, int yc, int radius, color_t color, bool filled) {
+    if (!view.pixels || radius < 0)
+        return;
+    int x = -radius, y = 0, err = 2 - 2 * radius;
+    do {
+        if (filled) {
+            CCCP_ViewSpan(&view, yc - y, xc - x, xc + x, color);
+            CCCP_ViewSpan(&view, yc + y, xc - x, xc + x, color);
+        } else {
+            CCCP_ViewPut(&view, xc - x, yc + y, color);
+            CCCP_ViewPut(&view, xc - y, yc - x, color);
+            CCCP_ViewPut(&view, xc + x, yc - y, color);
+            CCCP_ViewPut(&view, xc + y, yc + x, color);
+        }
+        int r = err;
+        if (r <= y)
+            err += ++y * 2 + 1;
+        if (r > x || err > y)
+            err += ++x * 2 + 1;
+    } while (x < 0);
+    CCCP_MarkViewDirty(&view, xc - radius, yc - radius, radius * 2 + 1, radius * 2 + 1);
+}
+
+void CCCP_ViewDrawTriangle(CCCP_SurfaceView view, int x1, int y1, int x2, int y2, int x3, int y3, color_t color, bool filled) {
+    if (!view.pixels)
+        return;
+    if (!filled) {
+        CCCP_ViewDrawLine(view, x1, y1, x2, y2, color);
+        CCCP_ViewDrawLine(view, x2, y2, x3, y3, color);
+        CCCP_ViewDrawLine(view, x3, y3, x1, y1, color);
+        return;
+    }
+    // Sort top to bottom, then fill a span per row between the long edge
+    // (1 to 3) and whichever short edge the row falls on
+    int t;
+#define SWAP_VERTEX(A, B) (t = x##A, x##A = x##B, x##B = t, t = y##A, y##A = y##B, y##B = t)
+    if (y1 > y2)
+        SWAP_VERTEX(1, 2);
+    if (y1 > y3)
+        SWAP_VERTEX(1, 3);
+    if (y2 > y3)
+        SWAP_VERTEX(2, 3);
+#undef SWAP_VERTEX
+    if (y1 == y3) {
+        CCCP_ViewSpan(&view, y1, min(x1, min(x2, x3)), max(x1, max(x2, x3)), color);
+    } else {
+        for (int y = max(y1, 0); y <= min(y3, view.h - 1); y++) {
+            int a = x1 + (int)((long long)(x3 - x1) * (y - y1) / (y3 - y1));
+            int b = y < y2 || y2 == y3 ?
+                x1 + (int)((long long)(x2 - x1) * (y - y1) / (y2 - y1)) :
+                x2 + (int)((long long)(x3 - x2) * (y - y2) / (y3 - y2));
+            CCCP_ViewSpan(&view, y, a, b, color);
+        }
+    }
+    int minX = min(x1, min(x2, x3));
+    CCCP_MarkViewDirty(&view, minX, y1, max(x1, max(x2, x3)) - minX + 1, y3 - y1 + 1);
 }
 
 void CCCP_DrawLine(CCCP_Surface surface, int x1, int y1, int x2, int y2, color_t color) {
-    bitmap_draw_line(surface, x1, y1, x2, y2, color);
+    CCCP_ViewDrawLine(CCCP_SurfaceAsView(surface), x1, y1, x2, y2, color);
 }
 
 void CCCP_DrawRect(CCCP_Surface surface, int x, int y, int w, int h, color_t color, bool filled) {
-    bitmap_draw_rectangle(surface, x, y, w, h, color, filled);
+    CCCP_ViewDrawRect(CCCP_SurfaceAsView(surface), x, y, w, h, color, filled);
 }
 
 void CCCP_DrawCircle(CCCP_Surface surface, int x, int y, int radius, color_t color, bool filled) {
-    bitmap_draw_circle(surface, x, y, radius, color, filled);
+    CCCP_ViewDrawCircle(CCCP_SurfaceAsView(surface), x, y, radius, color, filled);
 }
 
 void CCCP_DrawTriangle(CCCP_Surface surface, int x1, int y1, int x2, int y2, int x3, int y3, color_t color, bool filled) {
-    bitmap_draw_triangle(surface, x1, y1, x2, y2, x3, y3, color, filled);
+    CCCP_ViewDrawTriangle(CCCP_SurfaceAsView(surface), x1, y1, x2, y2, x3, y3, color, filled);
 }
 
 CCCP_Surface CCCP_ResizeSurface(CCCP_Surface surface, unsigned int w, unsigned int h) {
-    return bitmap_resized(surface, w, h);
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface result = bitmap_resized(surface, w, h);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return result;
 }
 CCCP_Surface CCCP_RotateSurface(CCCP_Surface surface, float angle) {
-    return bitmap_rotated(surface, angle);
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface result = bitmap_rotated(surface, angle);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return result;
 }
 
 CCCP_Surface CCCP_FlipSurface(CCCP_Surface surface, bool horizontal, bool vertical) {
-    return bitmap_flipped(surface, horizontal, vertical);
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface result = bitmap_flipped(surface, horizontal, vertical);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return result;
 }
 
 CCCP_Surface CCCP_ClipSurface(CCCP_Surface surface, int x, int y, int w, int h) {
-    return bitmap_clipped(surface, x, y, w, h);
+    bool temporary = CCCP_EnterFrameArena();
+    CCCP_Surface result = bitmap_clipped(surface, x, y, w, h);
+    if (temporary)
+        CCCP_LeaveFrameArena();
+    return result;
 }
 
 CCCP_Surface CCCP_SurfaceFromPerlinNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -150,7 +923,7 @@ CCCP_Surface CCCP_SurfaceFromPerlinNoise(unsigned int width, unsigned int height
 }
 
 CCCP_Surface CCCP_SurfaceFromSimplexNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -168,7 +941,7 @@ CCCP_Surface CCCP_SurfaceFromSimplexNoise(unsigned int width, unsigned int heigh
 }
 
 CCCP_Surface CCCP_SurfaceFromWorleyNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -186,7 +959,7 @@ CCCP_Surface CCCP_SurfaceFromWorleyNoise(unsigned int width, unsigned int height
 }
 
 CCCP_Surface CCCP_SurfaceFromValueNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -204,7 +977,7 @@ CCCP_Surface CCCP_SurfaceFromValueNoise(unsigned int width, unsigned int height,
 }
 
 CCCP_Surface CCCP_SurfaceFromWhiteNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -222,7 +995,7 @@ CCCP_Surface CCCP_SurfaceFromWhiteNoise(unsigned int width, unsigned int height,
 }
 
 CCCP_Surface CCCP_SurfaceFromFBMNoise(unsigned int width, unsigned int height, float scale, float offsetX, float offsetY, float lacunarity, float gain, int octaves) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -240,7 +1013,7 @@ CCCP_Surface CCCP_SurfaceFromFBMNoise(unsigned int width, unsigned int height, f
 }
 
 CCCP_Surface CCCP_SurfaceFromHorizontalGradient(unsigned int width, unsigned int height, color_t startColor, color_t endColor) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -259,7 +1032,7 @@ CCCP_Surface CCCP_SurfaceFromHorizontalGradient(unsigned int width, unsigned int
 }
 
 CCCP_Surface CCCP_SurfaceFromVerticalGradient(unsigned int width, unsigned int height, color_t startColor, color_t endColor) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -278,7 +1051,7 @@ CCCP_Surface CCCP_SurfaceFromVerticalGradient(unsigned int width, unsigned int h
 }
 
 CCCP_Surface CCCP_SurfaceFromRadialGradient(unsigned int width, unsigned int height, color_t centerColor, color_t edgeColor) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -304,7 +1077,7 @@ CCCP_Surface CCCP_SurfaceFromRadialGradient(unsigned int width, unsigned int hei
 }
 
 CCCP_Surface CCCP_SurfaceFromDiagonalGradient(unsigned int width, unsigned int height, color_t startColor, color_t endColor) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -323,7 +1096,7 @@ CCCP_Surface CCCP_SurfaceFromDiagonalGradient(unsigned int width, unsigned int h
 }
 
 CCCP_Surface CCCP_SurfaceFromCheckerboard(unsigned int width, unsigned int height, color_t color1, color_t color2, unsigned int squareSize) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -338,7 +1111,7 @@ CCCP_Surface CCCP_SurfaceFromCheckerboard(unsigned int width, unsigned int heigh
 }
 
 CCCP_Surface CCCP_SurfaceFromHorizontalStripes(unsigned int width, unsigned int height, color_t color1, color_t color2, unsigned int stripeWidth) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -352,7 +1125,7 @@ CCCP_Surface CCCP_SurfaceFromHorizontalStripes(unsigned int width, unsigned int
 }
 
 CCCP_Surface CCCP_SurfaceFromVerticalStripes(unsigned int width, unsigned int height, color_t color1, color_t color2, unsigned int stripeWidth) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
@@ -366,7 +1139,7 @@ CCCP_Surface CCCP_SurfaceFromVerticalStripes(unsigned int width, unsigned int he
 }
 
 CCCP_Surface CCCP_SurfaceFromConcentricCircles(unsigned int width, unsigned int height, color_t centerColor, color_t edgeColor, unsigned int numRings) {
-    CCCP_Surface surface = CCCP_NewSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
+    CCCP_Surface surface = CCCP_NewResultSurface(width, height, (color_t){0.0f, 0.0f, 0.0f, 1.0f});
     if (!surface)
         return NULL;
 
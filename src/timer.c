@@ -24,6 +24,15 @@
 #include <mach/mach_time.h>
 #else
 #include <time.h>
+#include <errno.h>
+#endif
+
+// Sleeps overshoot by the scheduler's wake-up latency, the last stretch
+// before a deadline is spent yielding instead. Windows sleeps in ticks
+#ifdef _WIN32
+#define SPIN_THRESHOLD .002
+#else
+#define SPIN_THRESHOLD .0005
 #endif
 
 typedef struct CCCP_Timer {
@@ -32,7 +41,7 @@ typedef struct CCCP_Timer {
     bool paused;
 } CCCP_Timer;
 
-static double CCCP_GetTime(void) {
+double CCCP_GetTime(void) {
 #ifdef _WIN32
     static LARGE_INTEGER frequency = {0};
     if (frequency.QuadPart == 0)
@@ -64,6 +73,25 @@ void CCCP_Sleep(double seconds) {
 #endif
 }
 
+void CCCP_SleepUntil(double deadline) {
+    double remaining = deadline - CCCP_GetTime();
+    if (remaining > SPIN_THRESHOLD) {
+#if defined(_WIN32) || defined(__APPLE__)
+        CCCP_Sleep(remaining - SPIN_THRESHOLD);
+#else
+        // Absolute, so time lost to signals or preemption isn't slept again
+        double wake = deadline - SPIN_THRESHOLD;
+        struct timespec ts;
+        ts.tv_sec = (time_t)wake;
+        ts.tv_nsec = (long)((wake - (double)ts.tv_sec) * 1000000000.0);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+#endif
+    }
+    while (CCCP_GetTime() < deadline)
+        thrd_yield();
+}
+
 CCCP_Timer* CCCP_NewTimer(void) {
     CCCP_Timer* timer = malloc(sizeof(CCCP_Timer));
     if (timer) {
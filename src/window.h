@@ -30,14 +30,26 @@ static struct {
     unsigned int windowHeight;
     int cursorX;
     int cursorY;
+    int smooth;
 } __state = {0};
 
 int WindowOpen(int w, int h, const char *title, CCCP_WindowFlags flags);
 int WindowPoll(void);
+int WindowPollWait(double timeout);
+int WindowExposed(void);
 void WindowFlush(CCCP_Surface buffer);
 void WindowClose(void);
 void WindowSetSize(unsigned int w, unsigned int h);
 void WindowSetTitle(const char *title);
+void WindowSetSmoothScaling(int enabled);
+CCCP_Surface WindowNewFramebuffer(unsigned int w, unsigned int h);
+void WindowDestroyFramebuffer(CCCP_Surface buffer);
+void WindowWaitFlush(void);
+int WindowCanFlushFromThread(void);
+
+void WindowSetSmoothScaling(int enabled) {
+    __state.smooth = enabled;
+}
 
 #define X(NAME, ARGS)                                           \
     void CCCP_Set##NAME##Callback(void(*NAME##Callback)ARGS) {  \
@@ -248,6 +260,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 goto DEFAULT_PROC;
             __wangblows_state.bmp->bmiHeader.biWidth = __state.w;
             __wangblows_state.bmp->bmiHeader.biHeight = -__state.h;
+            SetStretchBltMode(__wangblows_state.hdc, __state.smooth ? HALFTONE : COLORONCOLOR);
             StretchDIBits(__wangblows_state.hdc, 0, 0, __state.windowWidth, __state.windowHeight, 0, 0, __state.w, __state.h, __state.data, __wangblows_state.bmp, DIB_RGB_COLORS, SRCCOPY);
             ValidateRect(hWnd, NULL);
             break;
@@ -461,6 +474,18 @@ int WindowPoll(void) {
     return __state.running;
 }
 
+int WindowPollWait(double timeout) {
+    MSG msg;
+    if (!PeekMessage(&msg, __wangblows_state.hwnd, 0, 0, PM_NOREMOVE))
+        MsgWaitForMultipleObjects(0, NULL, FALSE, (DWORD)(timeout * 1000.0), QS_ALLINPUT);
+    return WindowPoll();
+}
+
+// WM_PAINT repaints from the last flushed frame by itself
+int WindowExposed(void) {
+    return 0;
+}
+
 void WindowFlush(CCCP_Surface buffer) {
     if (!buffer)
         return;
@@ -491,6 +516,20 @@ void WindowSetSize(unsigned int w, unsigned int h) {
 void WindowSetTitle(const char *title) {
     SetWindowText(state.hwnd, title);
 }
+
+CCCP_Surface WindowNewFramebuffer(unsigned int w, unsigned int h) {
+    return CCCP_NewSurface(w, h, rgb(0, 0, 0));
+}
+
+void WindowDestroyFramebuffer(CCCP_Surface buffer) {
+    CCCP_DestroySurface(buffer);
+}
+
+void WindowWaitFlush(void) {}
+
+int WindowCanFlushFromThread(void) {
+    return 0;
+}
 #elif defined(__APPLE__)
 #include <objc/objc.h>
 #include <objc/runtime.h>
@@ -705,6 +744,7 @@ static void drawRect(id self, SEL _self, CGRect rect) {
         CGContextSaveGState(ctx);
         CGContextTranslateCTM(ctx, 0, wh.size.height);
         CGContextScaleCTM(ctx, 1.0, -1.0);
+        CGContextSetInterpolationQuality(ctx, __state.smooth ? kCGInterpolationLow : kCGInterpolationNone);
         CGContextDrawImage(ctx, CGRectMake(0, 0, wh.size.width, wh.size.height), img);
         CGContextRestoreGState(ctx);
         CGImageRelease(img);
@@ -1244,6 +1284,36 @@ void WindowSetTitle(const char *title) {
         ObjC(void, id)(__mac_state.window, sel(setTitle:), titleStr);
     });
 }
+
+CCCP_Surface WindowNewFramebuffer(unsigned int w, unsigned int h) {
+    return CCCP_NewSurface(w, h, rgb(0, 0, 0));
+}
+
+void WindowDestroyFramebuffer(CCCP_Surface buffer) {
+    CCCP_DestroySurface(buffer);
+}
+
+int WindowPollWait(double timeout) {
+    if (!__state.running)
+        return 0;
+    AutoreleasePool({
+        id until = ObjC(id, double)(class(NSDate), sel(dateWithTimeIntervalSinceNow:), timeout);
+        // Only peeks, WindowPoll dequeues and dispatches
+        ObjC(id, unsigned long long, id, id, BOOL)(NSApp, sel(nextEventMatchingMask:untilDate:inMode:dequeue:), NSUIntegerMax, until, NSDefaultRunLoopMode, NO);
+    });
+    return WindowPoll();
+}
+
+// drawRect: repaints from the last flushed frame by itself
+int WindowExposed(void) {
+    return 0;
+}
+
+void WindowWaitFlush(void) {}
+
+int WindowCanFlushFromThread(void) {
+    return 0;
+}
 #else
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -1253,7 +1323,25 @@ void WindowSetTitle(const char *title) {
 #include <X11/keysymdef.h>
 #include <X11/keysym.h>
 #include <X11/Xatom.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
 #include <stdlib.h>
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Framebuffer whose pixels live in a MIT-SHM segment, the bitmap header
+// sits at the start of the segment so the surface is a regular bitmap_t
+struct __x11_framebuffer {
+    XShmSegmentInfo info;
+    XImage *image;
+    CCCP_Surface surface;
+    struct __x11_framebuffer *next;
+};
 
 static struct {
     Display *display;
@@ -1265,8 +1353,126 @@ static struct {
     GC gc;
     XImage *img, *scaler;
     int cursorLastX, cursorLastY;
+    int shm, shmCompletion;
+    atomic_int shmPending;
+    int scalerShm;
+    XShmSegmentInfo scalerInfo;
+    // Guards the scaler and window size between WindowFlush and a resize,
+    // the display lock is only held around the X calls themselves
+    mtx_t scalerLock;
+    struct __x11_framebuffer *framebuffers;
+    atomic_int exposed; // The window lost its contents, present the next frame whole
 } __linux_state = {0};
 
+static int __x11_shm_error = 0;
+
+static int ShmErrorHandler(Display *display, XErrorEvent *e) {
+    __x11_shm_error = 1;
+    return 0;
+}
+
+static XImage* CreateShmImage(XShmSegmentInfo *info, int w, int h, size_t header) {
+    XImage *image = XShmCreateImage(__linux_state.display, DefaultVisual(__linux_state.display, __linux_state.screen), __linux_state.depth, ZPixmap, NULL, info, w, h);
+    if (!image)
+        return NULL;
+    if (image->bytes_per_line != w * 4)
+        goto BAIL;
+    if ((info->shmid = shmget(IPC_PRIVATE, header + image->bytes_per_line * h, IPC_CREAT | 0600)) < 0)
+        goto BAIL;
+    if ((info->shmaddr = shmat(info->shmid, NULL, 0)) == (char*)-1) {
+        shmctl(info->shmid, IPC_RMID, NULL);
+        goto BAIL;
+    }
+    info->readOnly = False;
+    // Attaching fails on remote displays, which only shows up as an X error
+    __x11_shm_error = 0;
+    XErrorHandler handler = XSetErrorHandler(ShmErrorHandler);
+    XShmAttach(__linux_state.display, info);
+    XSync(__linux_state.display, False);
+    XSetErrorHandler(handler);
+    // Marked for removal now, it's released once both sides have detached
+    shmctl(info->shmid, IPC_RMID, NULL);
+    if (__x11_shm_error) {
+        shmdt(info->shmaddr);
+        __linux_state.shm = 0;
+        goto BAIL;
+    }
+    image->data = info->shmaddr + header;
+    return image;
+
+BAIL:
+    image->data = NULL;
+    XDestroyImage(image);
+    return NULL;
+}
+
+static void DestroyShmImage(XShmSegmentInfo *info, XImage *image) {
+    XShmDetach(__linux_state.display, info);
+    XSync(__linux_state.display, False);
+    image->data = NULL;
+    XDestroyImage(image);
+    shmdt(info->shmaddr);
+}
+
+// Whichever thread pulls a completion off the queue, it's counted here
+static int TakeShmCompletion(const XEvent *e) {
+    if (!__linux_state.shm || e->type != __linux_state.shmCompletion)
+        return 0;
+    atomic_fetch_sub(&__linux_state.shmPending, 1);
+    return 1;
+}
+
+static void DestroyScaler(void) {
+    if (!__linux_state.scaler)
+        return;
+    WindowWaitFlush();
+    if (__linux_state.scalerShm)
+        DestroyShmImage(&__linux_state.scalerInfo, __linux_state.scaler);
+    else {
+        __linux_state.scaler->data = NULL;
+        XDestroyImage(__linux_state.scaler);
+    }
+    __linux_state.scaler = NULL;
+    __linux_state.scalerShm = 0;
+}
+
+// color_t is r,g,b,a in memory, the visual decides where each channel goes.
+// Picked once in WindowOpen from the visual's channel masks
+enum {
+    SWIZZLE_NONE,    // Visual is RGBX already
+    SWIZZLE_RB,      // BGRX, by far the most common
+    SWIZZLE_GENERIC  // Anything else, shift and mask
+};
+
+static struct {
+    int kind;
+    uint32_t rs, gs, bs; // Destination bit offset of each channel
+    uint32_t alpha;      // 0xFF000000 when the top byte is free for alpha, 0 otherwise
+} __x11_swizzle = { SWIZZLE_NONE, 0, 8, 16, 0xFF000000 };
+
+static uint32_t MaskShift(unsigned long mask) {
+    uint32_t shift = 0;
+    while (mask && !(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+static void ChooseSwizzle(Visual *visual) {
+    __x11_swizzle.rs = MaskShift(visual->red_mask);
+    __x11_swizzle.gs = MaskShift(visual->green_mask);
+    __x11_swizzle.bs = MaskShift(visual->blue_mask);
+    // Alpha stays in the top byte, dropped if the visual puts a channel there
+    __x11_swizzle.alpha = ~(uint32_t)(visual->red_mask | visual->green_mask | visual->blue_mask) & 0xFF000000;
+    if (__x11_swizzle.rs == 0 && __x11_swizzle.gs == 8 && __x11_swizzle.bs == 16)
+        __x11_swizzle.kind = SWIZZLE_NONE;
+    else if (__x11_swizzle.rs == 16 && __x11_swizzle.gs == 8 && __x11_swizzle.bs == 0)
+        __x11_swizzle.kind = SWIZZLE_RB;
+    else
+        __x11_swizzle.kind = SWIZZLE_GENERIC;
+}
+
 struct Hints {
     unsigned long flags;
     unsigned long functions;
@@ -1276,12 +1482,21 @@ struct Hints {
 };
 
 int WindowOpen(int w, int h, const char *title, CCCP_WindowFlags flags) {
-    if (!(__linux_state.display = XOpenDisplay(NULL)))
+    // WindowFlush may be called from a present thread
+    if (!XInitThreads())
+        return 0;
+    if (mtx_init(&__linux_state.scalerLock, mtx_plain) != thrd_success)
         return 0;
+    if (!(__linux_state.display = XOpenDisplay(NULL))) {
+        mtx_destroy(&__linux_state.scalerLock);
+        return 0;
+    }
     __linux_state.root   = DefaultRootWindow(__linux_state.display);
     __linux_state.screen = DefaultScreen(__linux_state.display);
     __linux_state.scaler = NULL;
     __linux_state.buffer = NULL;
+    if ((__linux_state.shm = XShmQueryExtension(__linux_state.display)))
+        __linux_state.shmCompletion = XShmGetEventBase(__linux_state.display) + ShmCompletion;
 
     int screen_w = DisplayWidth(__linux_state.display, __linux_state.screen);
     int screen_h = DisplayHeight(__linux_state.display, __linux_state.screen);
@@ -1311,6 +1526,8 @@ int WindowOpen(int w, int h, const char *title, CCCP_WindowFlags flags) {
     XFree(formats);
     if (depth_c != 32)
         return 0;
+    ChooseSwizzle(visual);
+    atomic_store(&__linux_state.exposed, 1);
 
     XSetWindowAttributes swa;
     swa.override_redirect = True;
@@ -1578,6 +1795,8 @@ int WindowPoll(void) {
     XEvent e;
     while (__state.running && XPending(__linux_state.display)) {
         XNextEvent(__linux_state.display, &e);
+        if (TakeShmCompletion(&e))
+            continue;
         switch (e.type) {
             case KeyPress:
             case KeyRelease:
@@ -1626,17 +1845,19 @@ int WindowPoll(void) {
                 if (__state.windowWidth == w && __state.windowHeight == h)
                     break;
                 __callback(Resized, w, h);
+                // Keep the present thread out of the scaler while it's replaced
+                mtx_lock(&__linux_state.scalerLock);
                 __state.windowWidth = w;
                 __state.windowHeight = h;
-
-                if (__linux_state.scaler) {
-                    __linux_state.scaler->data = NULL;
-                    XDestroyImage(__linux_state.scaler);
-                    __linux_state.scaler = NULL;
-                }
+                DestroyScaler();
+                mtx_unlock(&__linux_state.scalerLock);
                 XClearWindow(__linux_state.display, __linux_state.window);
+                atomic_store(&__linux_state.exposed, 1);
                 break;
             }
+            case Expose:
+                atomic_store(&__linux_state.exposed, 1);
+                break;
             case ClientMessage:
                 if (e.xclient.data.l[0] != __linux_state.delete)
                     break;
@@ -1647,25 +1868,316 @@ int WindowPoll(void) {
     return __state.running;
 }
 
-static int* scale(int *data, int w, int h, int nw, int nh) {
-    assert(data && w && h && nw && nh);
-    assert(!(w == nw && h == nh));
-    int *result = malloc(sizeof(int) * nw * nh);
+static inline uint32_t swizzle_pixel(uint32_t p) {
+    return ((p & 0xFF) << __x11_swizzle.rs)
+         | (((p >> 8) & 0xFF) << __x11_swizzle.gs)
+         | (((p >> 16) & 0xFF) << __x11_swizzle.bs)
+         | (p & __x11_swizzle.alpha);
+}
+
+static inline uvec4 swizzle_pixels4(uvec4 p) {
+    return ((p & 0xFF) << __x11_swizzle.rs)
+         | (((p >> 8) & 0xFF) << __x11_swizzle.gs)
+         | (((p >> 16) & 0xFF) << __x11_swizzle.bs)
+         | (p & __x11_swizzle.alpha);
+}
+
+// Straight 1:1 conversion, byte shuffles for the red/blue swap
+static void swizzle_row(uint32_t *dst, const uint32_t *src, int n) {
+    int x = 0;
+    switch (__x11_swizzle.kind) {
+        case SWIZZLE_NONE:
+            memcpy(dst, src, n * sizeof(uint32_t));
+            return;
+        case SWIZZLE_RB: {
+#if defined(__AVX2__)
+            const __m256i mask8 = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                                   2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+            for (; x + 8 <= n; x += 8)
+                _mm256_storeu_si256((__m256i*)(dst + x), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + x)), mask8));
+#endif
+#if defined(__SSSE3__)
+            const __m128i mask4 = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+            for (; x + 4 <= n; x += 4)
+                _mm_storeu_si128((__m128i*)(dst + x), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x)), mask4));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            static const uint8_t indices[16] = { 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 };
+            const uint8x16_t mask4 = vld1q_u8(indices);
+            for (; x + 4 <= n; x += 4)
+                vst1q_u8((uint8_t*)(dst + x), vqtbl1q_u8(vld1q_u8((const uint8_t*)(src + x)), mask4));
+#else
+            // No byte shuffle without -march, swapping with shifts still
+            // takes plain SSE2 four pixels at a time
+            const uint32_t keep = 0x0000FF00 | __x11_swizzle.alpha;
+            for (; x + 4 <= n; x += 4) {
+                uvec4 v;
+                memcpy(&v, src + x, sizeof(v));
+                v = (v & keep) | ((v & 0xFF) << 16) | ((v >> 16) & 0xFF);
+                memcpy(dst + x, &v, sizeof(v));
+            }
+#endif
+            break;
+        }
+        default:
+            for (; x + 4 <= n; x += 4) {
+                uvec4 v;
+                memcpy(&v, src + x, sizeof(v));
+                v = swizzle_pixels4(v);
+                memcpy(dst + x, &v, sizeof(v));
+            }
+            break;
+    }
+    for (; x < n; ++x)
+        dst[x] = swizzle_pixel(src[x]);
+}
+
+// A scale is split into bands of rows that the caller and the runtime's
+// pool claim by bumping `next`, `remaining` counts workers still running
+#define SCALE_BAND_ROWS 32
+
+typedef struct {
+    const uint32_t *src;
+    uint32_t *dst;
+    int w, h, nw, nh;
+    int smooth;
+    int bands;
+    atomic_int next;
+    atomic_int remaining;
+} __x11_scale_job;
+
+static void scale_nearest(const __x11_scale_job *job, int start, int end) {
+    int w = job->w, nw = job->nw;
     int x_ratio = (int)((w << 16) / nw) + 1;
-    int y_ratio = (int)((h << 16) / nh) + 1;
-    int x2, y2, i, j;
-    for (i = 0; i < nh; ++i) {
-        int *t = result + i * nw;
-        y2 = ((i * y_ratio) >> 16);
-        int *p = data + y2 * w;
+    int y_ratio = (int)((job->h << 16) / job->nh) + 1;
+    for (int i = start; i < end; ++i) {
+        uint32_t *t = job->dst + i * nw;
+        const uint32_t *p = job->src + ((i * y_ratio) >> 16) * w;
         int rat = 0;
-        for (j = 0; j < nw; ++j) {
-            x2 = (rat >> 16);
-            *t++ = p[x2];
+        for (int j = 0; j < nw; ++j) {
+            *t++ = swizzle_pixel(p[rat >> 16]);
             rat += x_ratio;
         }
     }
-    return result;
+}
+
+// Integer ratios are plain pixel repetition, 2x and 4x use vector shuffles.
+// Pixels are swizzled as they're loaded so conversion costs no extra pass
+static void expand_row(uint32_t *dst, const uint32_t *src, int w, int k) {
+    int x = 0;
+    switch (k) {
+        case 1:
+            swizzle_row(dst, src, w);
+            return;
+        case 2:
+            for (; x + 4 <= w; x += 4, dst += 8) {
+                uvec4 v, lo, hi;
+                memcpy(&v, src + x, sizeof(v));
+                v = swizzle_pixels4(v);
+                lo = __builtin_shufflevector(v, v, 0, 0, 1, 1);
+                hi = __builtin_shufflevector(v, v, 2, 2, 3, 3);
+                memcpy(dst, &lo, sizeof(lo));
+                memcpy(dst + 4, &hi, sizeof(hi));
+            }
+            break;
+        case 4:
+            for (; x + 4 <= w; x += 4, dst += 16) {
+                uvec4 v, out[4];
+                memcpy(&v, src + x, sizeof(v));
+                v = swizzle_pixels4(v);
+                out[0] = __builtin_shufflevector(v, v, 0, 0, 0, 0);
+                out[1] = __builtin_shufflevector(v, v, 1, 1, 1, 1);
+                out[2] = __builtin_shufflevector(v, v, 2, 2, 2, 2);
+                out[3] = __builtin_shufflevector(v, v, 3, 3, 3, 3);
+                memcpy(dst, out, sizeof(out));
+            }
+            break;
+    }
+    for (; x < w; ++x) {
+        uint32_t p = swizzle_pixel(src[x]);
+        for (int i = 0; i < k; ++i)
+            *dst++ = p;
+    }
+}
+
+static void scale_integer(const __x11_scale_job *job, int start, int end) {
+    int kx = job->nw / job->w, ky = job->nh / job->h;
+    for (int i = start; i < end; ++i) {
+        uint32_t *t = job->dst + i * job->nw;
+        // Repeated rows are copies of the one above
+        if (i > start && i % ky)
+            memcpy(t, t - job->nw, job->nw * sizeof(uint32_t));
+        else
+            expand_row(t, job->src + (i / ky) * job->w, job->w, kx);
+    }
+}
+
+static void scale_bilinear(const __x11_scale_job *job, int start, int end) {
+    int w = job->w, h = job->h, nw = job->nw;
+    // 16.16 fixed point, sample at pixel centres
+    int x_ratio = (int)(((int64_t)w << 16) / nw);
+    int y_ratio = (int)(((int64_t)h << 16) / job->nh);
+    for (int i = start; i < end; ++i) {
+        int sy = (i * y_ratio + (y_ratio >> 1)) - 0x8000;
+        if (sy < 0)
+            sy = 0;
+        int y1 = sy >> 16;
+        int y2 = y1 + 1 < h ? y1 + 1 : y1;
+        uint32_t fy = (sy >> 8) & 0xFF;
+        const uint32_t *r1 = job->src + y1 * w;
+        const uint32_t *r2 = job->src + y2 * w;
+        uint32_t *t = job->dst + i * nw;
+        for (int j = 0; j < nw; ++j) {
+            int sx = (j * x_ratio + (x_ratio >> 1)) - 0x8000;
+            if (sx < 0)
+                sx = 0;
+            int x1 = sx >> 16;
+            int x2 = x1 + 1 < w ? x1 + 1 : x1;
+            uint32_t fx = (sx >> 8) & 0xFF;
+            uint32_t a = r1[x1], b = r1[x2], c = r2[x1], d = r2[x2];
+            // Blend two channels at a time, red/blue and green/alpha
+            uint32_t out = 0;
+            for (int shift = 0; shift < 16; shift += 8) {
+                uint32_t m = 0x00FF00FFu << shift;
+                uint32_t top = ((((a & m) >> shift) * (256 - fx) + ((b & m) >> shift) * fx) >> 8) & 0x00FF00FF;
+                uint32_t bot = ((((c & m) >> shift) * (256 - fx) + ((d & m) >> shift) * fx) >> 8) & 0x00FF00FF;
+                out |= (((top * (256 - fy) + bot * fy) >> 8) & 0x00FF00FF) << shift;
+            }
+            *t++ = swizzle_pixel(out);
+        }
+    }
+}
+
+static void ScaleWorker(void *arg) {
+    __x11_scale_job *job = (__x11_scale_job*)arg;
+    int integer = (!job->smooth || (job->w == job->nw && job->h == job->nh)) && !(job->nw % job->w) && !(job->nh % job->h);
+    int band;
+    while ((band = atomic_fetch_add(&job->next, 1)) < job->bands) {
+        int y0 = band * SCALE_BAND_ROWS;
+        int y1 = y0 + SCALE_BAND_ROWS < job->nh ? y0 + SCALE_BAND_ROWS : job->nh;
+        if (integer)
+            scale_integer(job, y0, y1);
+        else if (job->smooth)
+            scale_bilinear(job, y0, y1);
+        else
+            scale_nearest(job, y0, y1);
+    }
+    atomic_fetch_sub(&job->remaining, 1);
+}
+
+// Also used at 1:1 when the visual needs a swizzle, the integer path
+// then degrades to a straight converting copy
+static void scale(int *data, int w, int h, int *result, int nw, int nh) {
+    assert(data && w && h && result && nw && nh);
+    __x11_scale_job job = {
+        .src = (const uint32_t*)data,
+        .dst = (uint32_t*)result,
+        .w = w, .h = h, .nw = nw, .nh = nh,
+        .smooth = __state.smooth,
+        .bands = (nh + SCALE_BAND_ROWS - 1) / SCALE_BAND_ROWS
+    };
+    atomic_store(&job.next, 0);
+    atomic_store(&job.remaining, 1);
+    // Spread the bands over the runtime's pool, this thread takes part too.
+    // Waits on the job's own counter, the pool may be busy with the next frame
+    CCCP_ThreadPool *pool = CCCP_GetThreadPool();
+    int helpers = pool ? CCCP_ThreadPoolSize(pool) : 0;
+    if (helpers > job.bands - 1)
+        helpers = job.bands - 1;
+    for (int i = 0; i < helpers; ++i) {
+        atomic_fetch_add(&job.remaining, 1);
+        if (!CCCP_ThreadPoolSubmit(pool, ScaleWorker, &job)) {
+            atomic_fetch_sub(&job.remaining, 1);
+            break;
+        }
+    }
+    ScaleWorker(&job);
+    while (atomic_load(&job.remaining) > 0)
+        thrd_yield();
+}
+
+int WindowPollWait(double timeout) {
+    double deadline = CCCP_GetTime() + timeout;
+    // Blocks on the connection instead of spinning. The present thread can
+    // read the socket too, waits are sliced so queued events aren't missed
+    while (__state.running && !XEventsQueued(__linux_state.display, QueuedAfterFlush)) {
+        double remaining = deadline - CCCP_GetTime();
+        if (remaining <= 0)
+            break;
+        struct pollfd fd = { ConnectionNumber(__linux_state.display), POLLIN, 0 };
+        poll(&fd, 1, (int)ceil((remaining < .1 ? remaining : .1) * 1000.0));
+    }
+    return WindowPoll();
+}
+
+int WindowExposed(void) {
+    return atomic_load(&__linux_state.exposed);
+}
+
+static Bool IsShmCompletion(Display *display, XEvent *e, XPointer arg) {
+    return e->type == __linux_state.shmCompletion;
+}
+
+void WindowWaitFlush(void) {
+    XEvent e;
+    // Only completion events are pulled off the queue, input stays for WindowPoll.
+    // Polling rather than blocking, WindowPoll on another thread may take the event
+    while (atomic_load(&__linux_state.shmPending) > 0)
+        if (!XCheckIfEvent(__linux_state.display, &e, IsShmCompletion, NULL) || !TakeShmCompletion(&e))
+            CCCP_Sleep(.0001);
+}
+
+int WindowCanFlushFromThread(void) {
+    return 1;
+}
+
+static struct __x11_framebuffer* FindFramebuffer(CCCP_Surface buffer) {
+    for (struct __x11_framebuffer *fb = __linux_state.framebuffers; fb; fb = fb->next)
+        if (fb->surface == buffer)
+            return fb;
+    return NULL;
+}
+
+CCCP_Surface WindowNewFramebuffer(unsigned int w, unsigned int h) {
+    if (!w || !h)
+        return NULL;
+    if (__linux_state.shm) {
+        struct __x11_framebuffer *fb = malloc(sizeof(struct __x11_framebuffer));
+        if (!fb)
+            return NULL;
+        if ((fb->image = CreateShmImage(&fb->info, w, h, BITMAP_HEADER_SIZE))) {
+            fb->surface = bitmap_wrap(fb->info.shmaddr, w, h);
+            CCCP_ClearSurface(fb->surface, rgb(0, 0, 0));
+            fb->next = __linux_state.framebuffers;
+            __linux_state.framebuffers = fb;
+            return fb->surface;
+        }
+        free(fb);
+    }
+    return CCCP_NewSurface(w, h, rgb(0, 0, 0));
+}
+
+void WindowDestroyFramebuffer(CCCP_Surface buffer) {
+    struct __x11_framebuffer **fb = &__linux_state.framebuffers;
+    while (*fb && (*fb)->surface != buffer)
+        fb = &(*fb)->next;
+    if (!*fb) {
+        CCCP_DestroySurface(buffer);
+        return;
+    }
+    struct __x11_framebuffer *found = *fb;
+    *fb = found->next;
+    CCCP_TrackDirtyRegions(buffer, false);
+    WindowWaitFlush();
+    DestroyShmImage(&found->info, found->image);
+    free(found);
+}
+
+static void PutImage(XImage *image, int shm, const CCCP_Rect *rect) {
+    if (shm) {
+        XShmPutImage(__linux_state.display, __linux_state.window, __linux_state.gc, image, rect->x, rect->y, rect->x, rect->y, rect->w, rect->h, True);
+        atomic_fetch_add(&__linux_state.shmPending, 1);
+    } else
+        XPutImage(__linux_state.display, __linux_state.window, __linux_state.gc, image, rect->x, rect->y, rect->x, rect->y, rect->w, rect->h);
 }
 
 void WindowFlush(CCCP_Surface buffer) {
@@ -1675,43 +2187,95 @@ void WindowFlush(CCCP_Surface buffer) {
     bitmap_size(buffer, &w, &h);
     if (!w || !h)
         return;
-    if (__state.windowWidth != w || __state.windowHeight != h) {
-        if (__linux_state.scaler) {
-            __linux_state.scaler->data = NULL;
-            XDestroyImage(__linux_state.scaler);
-            __linux_state.scaler = NULL;
+    // Waiting on the server and scaling happen outside the display lock so
+    // WindowPoll on the main thread is never held up by a present
+    mtx_lock(&__linux_state.scalerLock);
+    // Never scale into an image made for another window size
+    if (__linux_state.scaler && (__linux_state.scaler->width != __state.windowWidth || __linux_state.scaler->height != __state.windowHeight))
+        DestroyScaler();
+    CCCP_Rect rects[CCCP_MAX_DIRTY_RECTS];
+    int count = -1;
+    // Only what changed goes up. Resampled frames, a window that lost its
+    // contents and a scaler that doesn't hold the last frame yet go up whole
+    int exposed = atomic_exchange(&__linux_state.exposed, 0);
+    if (!exposed && __state.windowWidth == w && __state.windowHeight == h && (__x11_swizzle.kind == SWIZZLE_NONE || __linux_state.scaler))
+        count = CCCP_GetDirtyRects(buffer, rects, CCCP_MAX_DIRTY_RECTS);
+    if (!count) {
+        mtx_unlock(&__linux_state.scalerLock);
+        return;
+    }
+    if (count < 0 || (count == 1 && rects[0].w == w && rects[0].h == h)) {
+        count = -1;
+        rects[0] = (CCCP_Rect){0, 0, __state.windowWidth, __state.windowHeight};
+    }
+    XImage *image;
+    int shm;
+    // Presenting straight from the framebuffer only works when no conversion is needed
+    if (__state.windowWidth != w || __state.windowHeight != h || __x11_swizzle.kind != SWIZZLE_NONE) {
+        if (!__linux_state.scaler) {
+            XLockDisplay(__linux_state.display);
+            if (__linux_state.shm && (__linux_state.scaler = CreateShmImage(&__linux_state.scalerInfo, __state.windowWidth, __state.windowHeight, 0)))
+                __linux_state.scalerShm = 1;
+            else {
+                __linux_state.buffer = realloc(__linux_state.buffer, sizeof(int) * __state.windowWidth * __state.windowHeight);
+                __linux_state.scaler = XCreateImage(__linux_state.display, CopyFromParent, __linux_state.depth, ZPixmap, 0, (char*)__linux_state.buffer, __state.windowWidth, __state.windowHeight, 32, __state.windowWidth * 4);
+            }
+            XUnlockDisplay(__linux_state.display);
         }
-        __linux_state.scaler = XCreateImage(__linux_state.display, CopyFromParent, __linux_state.depth, ZPixmap, 0, NULL, __state.windowWidth, __state.windowHeight, 32, __state.windowWidth * 4);
-
-        if (__linux_state.buffer)
-            free(__linux_state.buffer);
-        __linux_state.buffer = scale((int*)buffer, w, h, __state.windowWidth, __state.windowHeight);
-        __linux_state.scaler->data = (char*)__linux_state.buffer;
-        XPutImage(__linux_state.display, __linux_state.window, __linux_state.gc, __linux_state.scaler, 0, 0, 0, 0, __state.windowWidth, __state.windowHeight);
+        // The server may still be reading the last frame out of the scaler
+        WindowWaitFlush();
+        if (count < 0)
+            scale((int*)buffer, w, h, (int*)__linux_state.scaler->data, __state.windowWidth, __state.windowHeight);
+        else
+            // 1:1 here, the rest of the scaler still holds what's on screen
+            for (int i = 0; i < count; i++)
+                for (int y = rects[i].y; y < rects[i].y + rects[i].h; y++)
+                    swizzle_row((uint32_t*)__linux_state.scaler->data + y * w + rects[i].x, (const uint32_t*)buffer + y * w + rects[i].x, rects[i].w);
+        image = __linux_state.scaler;
+        shm = __linux_state.scalerShm;
     } else {
-        __linux_state.img->data = (char*)buffer->buffer;
-        XPutImage(__linux_state.display, __linux_state.window, __linux_state.gc, __linux_state.img, 0, 0, 0, 0, __state.windowWidth, __state.windowHeight);
+        struct __x11_framebuffer *fb = FindFramebuffer(buffer);
+        image = fb ? fb->image : __linux_state.img;
+        shm = fb != NULL;
+        if (!fb) {
+            __linux_state.img->data = (char*)buffer;
+            __linux_state.img->width = w;
+            __linux_state.img->height = h;
+            __linux_state.img->bytes_per_line = w * 4;
+        }
     }
+    XLockDisplay(__linux_state.display);
+    for (int i = 0; i < (count < 0 ? 1 : count); i++)
+        PutImage(image, shm, &rects[i]);
     XFlush(__linux_state.display);
+    XUnlockDisplay(__linux_state.display);
+    mtx_unlock(&__linux_state.scalerLock);
 }
 
 void WindowClose(void) {
     assert(__state.running);
-    if (__linux_state.scaler) {
-        __linux_state.scaler->data = NULL;
-        XDestroyImage(__linux_state.scaler);
-    }
+    DestroyScaler();
+    while (__linux_state.framebuffers)
+        WindowDestroyFramebuffer(__linux_state.framebuffers->surface);
     if (__linux_state.buffer)
         free(__linux_state.buffer);
     __linux_state.img->data = NULL;
     XDestroyImage(__linux_state.img);
     XDestroyWindow(__linux_state.display, __linux_state.window);
     XCloseDisplay(__linux_state.display);
+    mtx_destroy(&__linux_state.scalerLock);
 }
 
 void WindowSetSize(unsigned int w, unsigned int h) {
-    __state.windowWidth = w;
-    __state.windowHeight = h;
+    mtx_lock(&__linux_state.scalerLock);
+    // The ConfigureNotify echo will match the new size and be skipped, so
+    // the scaler has to go here or the next present overruns it
+    if (__state.windowWidth != w || __state.windowHeight != h) {
+        __state.windowWidth = w;
+        __state.windowHeight = h;
+        DestroyScaler();
+    }
+    mtx_unlock(&__linux_state.scalerLock);
     XResizeWindow(__linux_state.display, __linux_state.window, w, h);
 }
 
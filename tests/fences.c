@@ -0,0 +1,119 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A job that won't finish until it's told to sits on the pool while shader
+// passes and blits run. Waiting on a fence, on every fence, on a sync pass
+// or on a banded blit must only wait for that work, never drain the pool.
+
+#include "cccp.h"
+#include <stdio.h>
+#include <time.h>
+
+#define W 256
+#define H 192
+// The blocker gives up after this long so a regression fails instead of hanging
+#define BLOCKER_SECONDS 5
+
+static int failures = 0;
+static atomic_bool release, finished;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void blocker(void *arg) {
+    (void)arg;
+    time_t start = time(NULL);
+    while (!atomic_load(&release) && time(NULL) - start < BLOCKER_SECONDS)
+        thrd_yield();
+    atomic_store(&finished, true);
+}
+
+static vec4 gradient(vec2 fragcoord, const CCCP_ShaderUniforms *uniforms, void *userdata) {
+    (void)uniforms;
+    float shade = *(float*)userdata;
+    return (vec4){ fragcoord[0] / W, fragcoord[1] / H, shade, 1.f };
+}
+
+static bool shaded(CCCP_Surface surface, float shade) {
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            if (surface[y * W + x].rgba != CCCP_PackColor(gradient((vec2){x + .5f, y + .5f}, NULL, &shade)).rgba)
+                return false;
+    return true;
+}
+
+int main(void) {
+    CCCP_ThreadPool *pool = CCCP_NewThreadPool(4);
+    if (!pool) {
+        fprintf(stderr, "ERROR: Failed to create a thread pool\n");
+        return 1;
+    }
+    CCCP_SetThreadPool(pool);
+    check(CCCP_FenceDone(0), "the null fence isn't done");
+    check(CCCP_ThreadPoolSubmit(pool, blocker, NULL), "blocker wasn't queued");
+
+    CCCP_Shader shader = CCCP_NewShader(gradient, 0);
+    float shades[3] = { .25f, .5f, .75f };
+    CCCP_Surface surfaces[3];
+    for (int i = 0; i < 3; i++)
+        surfaces[i] = CCCP_NewSurface(W, H, rgb(0, 0, 0));
+
+    CCCP_Fence fence = CCCP_ApplyShaderAsync(surfaces[0], &shader, &shades[0]);
+    check(fence != 0, "async pass wasn't started");
+    CCCP_WaitFence(fence);
+    check(CCCP_FenceDone(fence), "fence not done after waiting on it");
+    check(shaded(surfaces[0], shades[0]), "async pass drew the wrong pixels");
+
+    CCCP_Fence fences[2];
+    for (int i = 0; i < 2; i++)
+        fences[i] = CCCP_ApplyShaderAsync(surfaces[i + 1], &shader, &shades[i + 1]);
+    CCCP_WaitAllFences();
+    for (int i = 0; i < 2; i++) {
+        check(CCCP_FenceDone(fences[i]), "fence not done after waiting on all of them");
+        check(shaded(surfaces[i + 1], shades[i + 1]), "pass drew the wrong pixels");
+    }
+
+    check(CCCP_ApplyShader(surfaces[0], &shader, &shades[2]), "sync pass failed");
+    check(shaded(surfaces[0], shades[2]), "sync pass drew the wrong pixels");
+
+    CCCP_Surface big = CCCP_NewSurface(640, 480, rgb(10, 20, 30));
+    CCCP_Surface src = CCCP_NewSurface(640, 480, rgba(200, 100, 50, 128));
+    CCCP_BlitSurfaceMode(big, src, 0, 0, BLEND_SCREEN);
+    check(big[0].rgba == color_screen(rgb(10, 20, 30), rgba(200, 100, 50, 128)).rgba, "banded blit drew the wrong pixels");
+
+    // Everything above returned while the blocker was still running
+    check(!atomic_load(&finished), "a wait drained the whole pool");
+    atomic_store(&release, true);
+    CCCP_ThreadPoolWait(pool);
+    check(atomic_load(&finished), "blocker never ran");
+
+    for (int i = 0; i < 3; i++)
+        CCCP_DestroySurface(surfaces[i]);
+    CCCP_DestroySurface(big);
+    CCCP_DestroySurface(src);
+    CCCP_DestroyThreadPool(pool);
+    if (failures)
+        return 1;
+    printf("fences: ok\n");
+    return 0;
+}
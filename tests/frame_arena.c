@@ -0,0 +1,97 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Draws text between CCCP_BeginFrameArena and CCCP_EndFrameArena over two
+// frames. The glyphs cached on the first frame have to outlive the arena
+// reset, so the second frame must draw exactly the same pixels even after
+// every recycled block has been scribbled over.
+//
+// Usage: frame_arena <font.ttf>
+
+#include "cccp.h"
+#include <stdio.h>
+
+#define WIDTH 256
+#define HEIGHT 64
+#define TEXT "Frame arena"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void draw_frame(CCCP_Surface target, CCCP_Font *font) {
+    size_t before = 0, after = 0;
+    CCCP_ClearSurface(target, rgb(0, 0, 0));
+    check(CCCP_BeginFrameArena(), "arena bound");
+    CCCP_GetFrameArenaStats(&before, NULL);
+    CCCP_DrawText(target, font, 4, 4, TEXT, rgb(255, 255, 255), 32.f);
+    CCCP_GetFrameArenaStats(&after, NULL);
+    check(before == after, "text took memory from the arena");
+    // Transforms still hand back temporary surfaces
+    CCCP_Surface flipped = CCCP_FlipSurface(target, true, false);
+    CCCP_GetFrameArenaStats(&after, NULL);
+    check(flipped && after > before, "transform skipped the arena");
+    CCCP_EndFrameArena();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <font.ttf>\n", argv[0]);
+        return 1;
+    }
+    CCCP_Font *font = CCCP_LoadFont(argv[1]);
+    CCCP_FrameArena *arena = CCCP_NewFrameArena();
+    CCCP_Surface target = CCCP_NewSurface(WIDTH, HEIGHT, rgb(0, 0, 0));
+    if (!font || !arena || !target) {
+        fprintf(stderr, "ERROR: Failed to load \"%s\"\n", argv[1]);
+        return 1;
+    }
+    CCCP_SetFrameArena(arena);
+
+    draw_frame(target, font);
+    CCCP_Surface first = CCCP_CopySurface(target);
+    int lit = 0;
+    for (int i = 0; first && i < WIDTH * HEIGHT; i++)
+        lit += first[i].r > 0;
+    check(lit > 0, "first frame drew no text");
+    CCCP_ResetFrameArena(arena);
+
+    // Reuse every block the arena has, anything still pointing into them
+    // now reads magenta
+    for (unsigned int size = 8; size <= 512; size *= 2)
+        for (int i = 0; i < 8; i++)
+            CCCP_TempSurface(size, size, rgb(255, 0, 255));
+    draw_frame(target, font);
+    check(first && !memcmp(first, target, WIDTH * HEIGHT * sizeof(color_t)), "second frame drew different text");
+    CCCP_ResetFrameArena(arena);
+
+    CCCP_DestroySurface(first);
+    CCCP_DestroySurface(target);
+    CCCP_DestroyFrameArena(arena);
+    CCCP_DestroyFont(font);
+    if (failures)
+        return 1;
+    printf("frame_arena: ok\n");
+    return 0;
+}
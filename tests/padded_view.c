@@ -0,0 +1,147 @@
+/*
+ CCCP - The C Create Coding Project
+
+ Copyright (C) 2025 George Watson
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Padded surfaces report only their content: width, views, dirty rects and
+// blits must all stop at the requested width, and drawing through the padded
+// view must give the same pixels as drawing onto an unpadded surface.
+
+#include "cccp.h"
+#include <stdio.h>
+
+#define H 20
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static bool view_matches(CCCP_SurfaceView a, CCCP_Surface b) {
+    for (int y = 0; y < a.h; y++)
+        for (int x = 0; x < a.w; x++)
+            if (a.pixels[y * a.stride + x].rgba != b[y * a.w + x].rgba)
+                return false;
+    return true;
+}
+
+static bool rects_in_content(CCCP_Surface surface, int w) {
+    CCCP_Rect rects[16];
+    int count = CCCP_GetDirtyRects(surface, rects, 16);
+    if (!count)
+        return false;
+    for (int i = 0; i < count; i++)
+        if (rects[i].x < 0 || rects[i].x + rects[i].w > w)
+            return false;
+    return true;
+}
+
+static void test_layout(int w) {
+    CCCP_SurfaceView view = CCCP_NewPaddedSurface(w, H, rgb(0, 0, 0));
+    int stride = (w + CCCP_SURFACE_ROW_PIXELS - 1) / CCCP_SURFACE_ROW_PIXELS * CCCP_SURFACE_ROW_PIXELS;
+    check(view.surface != NULL, "padded surface wasn't created");
+    check(view.w == w && view.h == H && view.stride == stride, "padded view has the wrong size");
+    check(CCCP_SurfaceWidth(view.surface) == w, "surface width counts the padding");
+    CCCP_SurfaceView whole = CCCP_SurfaceAsView(view.surface);
+    check(whole.w == w && whole.stride == stride, "whole surface view includes the padding");
+    for (int y = 0; y < H; y++)
+        check((uintptr_t)(view.pixels + y * view.stride) % BITMAP_ALIGNMENT == 0, "padded row isn't aligned");
+
+    CCCP_TrackDirtyRegions(view.surface, true);
+    CCCP_ClearDirty(view.surface);
+    CCCP_ClearView(view, rgb(1, 2, 3));
+    check(rects_in_content(view.surface, w), "clearing dirtied the padding");
+    CCCP_ClearDirty(view.surface);
+    CCCP_MarkSurfaceDirty(view.surface);
+    check(rects_in_content(view.surface, w), "marking the surface dirtied the padding");
+    bool filled = true;
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < w; x++)
+            filled &= view.pixels[y * view.stride + x].rgba == rgb(1, 2, 3).rgba;
+    check(filled, "clear didn't fill the content");
+
+    // A wider source must stop at the content edge
+    CCCP_Surface wide = CCCP_NewSurface(stride + 16, H, rgb(9, 9, 9));
+    CCCP_BlitSurface(view.surface, wide, 0, 0);
+    bool contained = true;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < w; x++)
+            contained &= view.pixels[y * view.stride + x].rgba == rgb(9, 9, 9).rgba;
+        for (int x = w; x < stride; x++)
+            contained &= view.pixels[y * view.stride + x].rgba != rgb(9, 9, 9).rgba;
+    }
+    check(contained, "blit into a padded surface didn't stop at the content");
+
+    // And the padding must never be copied out
+    CCCP_Surface dest = CCCP_NewSurface(stride + 16, H, rgb(0, 0, 0));
+    CCCP_BlitSurface(dest, view.surface, 0, 0);
+    bool unpadded = true;
+    for (int y = 0; y < H; y++)
+        for (int x = w; x < stride + 16; x++)
+            unpadded &= dest[y * (stride + 16) + x].rgba == rgb(0, 0, 0).rgba;
+    check(unpadded, "blit from a padded surface copied the padding");
+
+    CCCP_DestroySurface(view.surface);
+    CCCP_DestroySurface(wide);
+    CCCP_DestroySurface(dest);
+}
+
+static void test_blits(int w) {
+    CCCP_SurfaceView padded = CCCP_NewPaddedSurface(w, H, rgb(40, 80, 120));
+    CCCP_Surface plain = CCCP_NewSurface(w, H, rgb(40, 80, 120));
+    CCCP_SurfaceView view = CCCP_SurfaceAsView(plain);
+    CCCP_Surface src = CCCP_NewSurface(w / 2 + 5, H - 3, rgb(0, 0, 0));
+    for (int y = 0; y < H - 3; y++)
+        for (int x = 0; x < w / 2 + 5; x++)
+            src[y * (w / 2 + 5) + x] = rgba(x * 7, y * 11, x ^ y, (x + y) * 9);
+    CCCP_SurfaceView source = CCCP_SurfaceAsView(src);
+    int offsets[][2] = { { 0, 0 }, { w / 3, 2 }, { w - 3, 5 }, { -4, -2 } };
+    for (int i = 0; i < 4; i++) {
+        int x = offsets[i][0], y = offsets[i][1];
+        CCCP_BlitView(padded, source, x, y);
+        CCCP_BlitView(view, source, x, y);
+        check(view_matches(padded, plain), "copy onto a padded view differs");
+        CCCP_BlitViewBlend(padded, source, x + 1, y + 1);
+        CCCP_BlitViewBlend(view, source, x + 1, y + 1);
+        check(view_matches(padded, plain), "blend onto a padded view differs");
+        CCCP_BlitViewMode(padded, source, x + 2, y, BLEND_MULTIPLY);
+        CCCP_BlitViewMode(view, source, x + 2, y, BLEND_MULTIPLY);
+        check(view_matches(padded, plain), "mode blend onto a padded view differs");
+        CCCP_ViewDrawRect(padded, x, y, w, 3, rgb(i, i, i), true);
+        CCCP_ViewDrawRect(view, x, y, w, 3, rgb(i, i, i), true);
+        check(view_matches(padded, plain), "filled rect on a padded view differs");
+    }
+    CCCP_DestroySurface(padded.surface);
+    CCCP_DestroySurface(plain);
+    CCCP_DestroySurface(src);
+}
+
+int main(void) {
+    int widths[] = { 1, 8, 37, 61, 64 };
+    for (int i = 0; i < (int)(sizeof(widths) / sizeof(widths[0])); i++) {
+        test_layout(widths[i]);
+        test_blits(widths[i]);
+    }
+    if (failures)
+        return 1;
+    printf("padded_view: ok\n");
+    return 0;
+}